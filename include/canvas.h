@@ -18,6 +18,21 @@
 #include <stdint.h>
 
 namespace rgb_matrix {
+struct Color {
+  Color() : r(0), g(0), b(0) {}
+  Color(uint8_t rr, uint8_t gg, uint8_t bb) : r(rr), g(gg), b(bb) {}
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+};
+
+struct Point {
+  Point() : x(0), y(0) {}
+  Point(int xx, int yy) : x(xx), y(yy) {}
+  int x;
+  int y;
+};
+
 // An interface for things a Canvas can do. The RGBMatrix implements this
 // interface, so you can use it directly wherever a canvas is needed.
 //
@@ -46,6 +61,32 @@ public:
 
   // Fill screen with given 24bpp color.
   virtual void Fill(uint8_t red, uint8_t green, uint8_t blue) = 0;
+
+  // -- Batched versions of SetPixel(). Points outside the canvas are
+  // skipped. These call SetPixel() for each pixel; implementations that can
+  // map a color once for many pixels (such as FrameCanvas) override them.
+
+  // Set the "count" pixels at "points" to the color with the same index
+  // in "colors".
+  virtual void SetPixels(const Point *points, const Color *colors, int count) {
+    for (int i = 0; i < count; ++i) {
+      SetPixel(points[i].x, points[i].y, colors[i].r, colors[i].g, colors[i].b);
+    }
+  }
+
+  // Set the "count" pixels at "points" to "color".
+  virtual void FillPixels(const Point *points, int count, const Color &color) {
+    for (int i = 0; i < count; ++i) {
+      SetPixel(points[i].x, points[i].y, color.r, color.g, color.b);
+    }
+  }
+
+  // Set the horizontal span of "width" pixels starting at "x","y" to "color".
+  virtual void FillSpan(int x, int y, int width, const Color &color) {
+    for (int i = 0; i < width; ++i) {
+      SetPixel(x + i, y, color.r, color.g, color.b);
+    }
+  }
 };
 
 }  // namespace rgb_matrix
@@ -1,19 +1,110 @@
 #ifndef CITY_H
 #define CITY_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 using namespace std;
 
-class City {
+// Cities stored as a structure of arrays: hot loops such as the map transform
+// only touch the contiguous coordinate arrays. Names live in a single string
+// arena and states are interned into small ids.
+class CityTable {
     public:
-        string name;
-        string state;
-        float lng;
-        float lat;
-        int x;
-        int y;
-        City(string name, string state, float lng, float lat, int x = 0, int y = 0);
+        // Append a city and return its position. Its matrix coordinates start
+        // out as (0, 0).
+        int Add(string_view name, string_view state, float lng, float lat,
+            int population = 0);
+        void Reserve(size_t n);
+        void Clear();
+
+        size_t size() const { return lng_.size(); }
+
+        string_view name(int i) const {
+            return string_view(names_.data() + name_start_[i],
+                name_start_[i + 1] - name_start_[i]);
+        }
+        uint8_t state_id(int i) const { return state_id_[i]; }
+        const string &state(int i) const { return states_[state_id_[i]]; }
+        float lng(int i) const { return lng_[i]; }
+        float lat(int i) const { return lat_[i]; }
+        int x(int i) const { return x_[i]; }
+        int y(int i) const { return y_[i]; }
+        int population(int i) const { return population_[i]; }
+
+        // Contiguous columns for batch processing.
+        const float *lngs() const { return lng_.data(); }
+        const float *lats() const { return lat_.data(); }
+        int16_t *xs() { return x_.data(); }
+        int16_t *ys() { return y_.data(); }
+        const int16_t *xs() const { return x_.data(); }
+        const int16_t *ys() const { return y_.data(); }
+
+        void set_xy(int i, int x, int y) { x_[i] = x; y_[i] = y; }
+
+        // Interned states. Ids are assigned in order of first appearance.
+        int state_count() const { return states_.size(); }
+        const string &state_code(int state_id) const { return states_[state_id]; }
+        // Id of the given state code, or -1 if no city is in that state.
+        int StateId(string_view state) const;
+
+    private:
+        int InternState(string_view state);
+
+        vector<float> lng_;
+        vector<float> lat_;
+        vector<int16_t> x_;
+        vector<int16_t> y_;
+        vector<uint8_t> state_id_;
+        vector<int32_t> population_;
+
+        // The name of city i is names_[name_start_[i]..name_start_[i + 1]).
+        string names_;
+        vector<uint32_t> name_start_ = vector<uint32_t>(1, 0);
+
+        vector<string> states_;
+        unordered_map<string, uint8_t> state_ids_;
+};
+
+// Lookup tables over a CityTable. The index stores positions into the table
+// and views of its names, so it has to be rebuilt if cities are added.
+class CityIndex {
+    public:
+        // Index the cities by state and name.
+        void BuildNameIndex(const CityTable &cities);
+
+        // Index the cities by their transformed (x, y) coordinates on a
+        // "width" x "height" matrix. Call again after the coordinates change,
+        // e.g. after a new calibration.
+        void BuildPixelIndex(const CityTable &cities, int width, int height);
+
+        // Position of the city with the given state and name, or -1. If the
+        // name occurs more than once in a state, the first one is returned.
+        int Find(string_view state, string_view name) const;
+
+        // Positions of the cities that land on pixel (x, y). Writes the count
+        // to "count"; returns NULL with a count of 0 outside the matrix.
+        const int *AtPixel(int x, int y, int *count) const;
+
+        int width() const { return width_; }
+        int height() const { return height_; }
+
+    private:
+        // Name lookup per state id.
+        const CityTable *cities_ = NULL;
+        vector<unordered_map<string_view, int> > by_name_;
+
+        // Cities sorted by pixel; the cities of pixel p are
+        // pixel_cities_[pixel_start_[p]..pixel_start_[p + 1]).
+        int width_ = 0;
+        int height_ = 0;
+        vector<int> pixel_start_;
+        vector<int> pixel_cities_;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,56 @@
+#ifndef CSV_READER_H
+#define CSV_READER_H
+
+#include <stddef.h>
+
+#include <string_view>
+#include <vector>
+
+// Split the CSV record in [begin, end) into fields. Quoted fields have their
+// quotes removed and doubled quotes ("") collapsed in place, so the returned
+// views point into the given buffer. Every field is followed by a NUL, so
+// field.data() can be handed to strtol() and friends; the byte at "end" must
+// be writable for that. A trailing "\n" or "\r\n" is ignored.
+// "fields" is cleared first; its capacity is reused.
+void SplitCSVRecord(char *begin, char *end,
+    std::vector<std::string_view> *fields);
+
+// Streaming reader for CSV files. Records are parsed in place in a buffer
+// that is reused for the whole file, so once the buffer and the field vector
+// have grown to their working size, reading does not allocate.
+class CSVReader {
+    public:
+        CSVReader();
+        ~CSVReader();
+
+        // Open the file at "path". Returns false if it cannot be opened.
+        bool Open(const char *path);
+        void Close();
+
+        // Advance to the next record. Returns false at the end of the file or
+        // on a read error. Quoted fields may contain commas and newlines.
+        bool NextRecord();
+
+        // Fields of the current record, NUL-terminated as with
+        // SplitCSVRecord(). The views are only valid until the next call to
+        // NextRecord().
+        size_t field_count() const { return fields_.size(); }
+        std::string_view field(size_t i) const { return fields_[i]; }
+        const std::vector<std::string_view> &fields() const { return fields_; }
+
+    private:
+        CSVReader(const CSVReader&);  // Not copyable; owns the file.
+
+        // Read more data, keeping the unparsed bytes at the start of the
+        // buffer. Returns false if nothing could be read.
+        bool Fill();
+
+        int fd_;
+        bool eof_;
+        std::vector<char> buffer_;
+        size_t begin_;  // Start of the unparsed data in buffer_.
+        size_t end_;    // End of the valid data in buffer_.
+        std::vector<std::string_view> fields_;
+};
+
+#endif
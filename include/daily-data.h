@@ -0,0 +1,69 @@
+#ifndef DAILY_DATA_H
+#define DAILY_DATA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Columns of daily.csv kept in the binary file. Missing values are stored as 0.
+enum DailyColumn {
+    DAILY_POSITIVE,
+    DAILY_NEGATIVE,
+    DAILY_DEATH,
+    DAILY_POSITIVE_INCREASE,
+    DAILY_DEATH_INCREASE,
+    DAILY_N_COLUMNS
+};
+
+// Convert the COVID Tracking Project CSV at "csv_path" into the columnar
+// binary format read by DailyData. Rows are grouped by date in ascending order
+// and a date index is written up front, so a day can be found with a binary
+// search. Returns false if the CSV could not be read or the binary written.
+bool ConvertDailyCSV(const char *csv_path, const char *bin_path);
+
+// Read-only view of a binary file written by ConvertDailyCSV(). The file is
+// mmap()ed; all accessors return pointers into the mapping and never allocate.
+class DailyData {
+    public:
+        DailyData();
+        ~DailyData();
+
+        // Map the file at "path". Returns false if it does not exist or does
+        // not look like a file written by ConvertDailyCSV().
+        bool Open(const char *path);
+        void Close();
+
+        int date_count() const;
+        int state_count() const;
+
+        // Date of the "date_index"th day as YYYYMMDD.
+        uint32_t date(int date_index) const;
+
+        // Two letter state code for the given state id, NUL-terminated.
+        const char *state_code(int state_id) const;
+
+        // Binary search for a YYYYMMDD date. Returns the date index or -1.
+        int FindDate(uint32_t yyyymmdd) const;
+
+        // Number of rows (one per reporting state) of the given day.
+        int row_count(int date_index) const;
+
+        // State ids of the rows of the given day.
+        const uint8_t *state_ids(int date_index) const;
+
+        // Values of "column" for the rows of the given day. The daily increase
+        // columns can be negative when a state corrected its numbers.
+        const int32_t *values(DailyColumn column, int date_index) const;
+
+    private:
+        DailyData(const DailyData&);  // Not copyable; owns the mapping.
+
+        void *mapping_;
+        size_t mapping_size_;
+        const struct DailyFileHeader *header_;
+        const char *state_codes_;
+        const struct DailyDateIndex *dates_;
+        const uint8_t *state_ids_;
+        const int32_t *columns_;
+};
+
+#endif
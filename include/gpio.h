@@ -16,13 +16,128 @@
 #ifndef RPI_GPIO_H
 #define RPI_GPIO_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include <atomic>
 #include <vector>
 
 // Putting this in our namespace to not collide with other things called like
 // this.
 namespace rgb_matrix {
+struct RefreshStats;
+
+// In-memory stand-in for the GPIO registers. A GPIO initialized with
+// InitSimulated() sends all writes here instead of to the hardware, so that
+// the refresh code can be run, measured and checked on any Linux machine.
+//
+// It keeps the state of the outputs and counts writes, output-enable pulses
+// and frames. Pulses are recorded, but take no time, so measurements only
+// show the time spent computing and writing the bits. The refresh thread
+// reads the inputs once after every frame; these reads mark the frame
+// boundaries.
+//
+// Only the refresh thread writes; the counters can be read from any thread.
+class SimulatedGPIO {
+ public:
+  enum Operation {
+    SET_BITS,
+    CLEAR_BITS,
+    WRITE_MASKED_BITS,
+    PULSE              // Output low for "mask" nanoseconds, then high again.
+  };
+
+  struct Write {
+    Operation op;
+    uint32_t value;
+    uint32_t mask;     // WRITE_MASKED_BITS: the bits written. PULSE: nanos.
+  };
+
+  SimulatedGPIO();
+
+  inline void SetBits(uint32_t value) {
+    outputs_ |= value;
+    Increment(&write_count_, 1);
+    if (recording_) Record(SET_BITS, value, 0);
+  }
+
+  inline void ClearBits(uint32_t value) {
+    outputs_ &= ~value;
+    Increment(&write_count_, 1);
+    if (recording_) Record(CLEAR_BITS, value, 0);
+  }
+
+  inline void WriteMaskedBits(uint32_t value, uint32_t mask) {
+    outputs_ = (outputs_ & ~mask) | (value & mask);
+    // Like the hardware: a clear and a set, each only if there are bits.
+    Increment(&write_count_, ((~value & mask) != 0) + ((value & mask) != 0));
+    // Only the bits that make it to the pins, so that the recording doesn't
+    // depend on what else the caller keeps in "value".
+    if (recording_) Record(WRITE_MASKED_BITS, value & mask, mask);
+  }
+
+  void Pulse(uint32_t bits, uint32_t nanos) {
+    Increment(&pulse_count_, 1);
+    Increment(&pulse_nanos_, nanos);
+    if (recording_) Record(PULSE, bits, nanos);
+  }
+
+  // Read the simulated inputs. Also the end of a frame, see above.
+  uint32_t Read();
+
+  // State of the outputs after the writes so far.
+  uint32_t outputs() const { return outputs_; }
+
+  // Simulate input pins, e.g. buttons.
+  void set_inputs(uint32_t inputs) { inputs_ = inputs; }
+
+  // Number of register writes, output-enable pulses, their total length,
+  // and of frames (reads of the inputs).
+  uint64_t write_count() const {
+    return write_count_.load(std::memory_order_relaxed);
+  }
+  uint64_t pulse_count() const {
+    return pulse_count_.load(std::memory_order_relaxed);
+  }
+  uint64_t pulse_nanos() const {
+    return pulse_nanos_.load(std::memory_order_relaxed);
+  }
+  uint64_t frame_count() const {
+    return frame_count_.load(std::memory_order_relaxed);
+  }
+
+  // Log all writes of the next "frames" (at least one) full frames. Must not
+  // be called while a recording is in progress.
+  void StartRecording(int frames);
+
+  // Whether the recording is complete. Only then, recording() may be used.
+  bool recording_done() const {
+    return recording_done_.load(std::memory_order_acquire);
+  }
+  const std::vector<Write> &recording() const { return recording_log_; }
+
+ private:
+  // Single writer, so no need for an atomic read-modify-write.
+  static inline void Increment(std::atomic<uint64_t> *counter, uint64_t n) {
+    counter->store(counter->load(std::memory_order_relaxed) + n,
+                   std::memory_order_relaxed);
+  }
+  void Record(Operation op, uint32_t value, uint32_t mask);
+
+  uint32_t outputs_;
+  uint32_t inputs_;
+  std::atomic<uint64_t> write_count_;
+  std::atomic<uint64_t> pulse_count_;
+  std::atomic<uint64_t> pulse_nanos_;
+  std::atomic<uint64_t> frame_count_;
+
+  bool recording_;         // Only used by the writing thread.
+  int frames_to_record_;
+  std::atomic<bool> recording_requested_;
+  std::atomic<bool> recording_done_;
+  std::vector<Write> recording_log_;
+};
+
 // For now, everything is initialized as output.
 class GPIO {
  public:
@@ -41,6 +156,14 @@ class GPIO {
 #endif
             );
 
+  // Initialize with in-memory registers instead of the hardware; all
+  // writes go to "simulation", which is not owned and has to outlive this
+  // object. Always succeeds.
+  bool InitSimulated(SimulatedGPIO *simulation);
+
+  // The simulation given to InitSimulated(), or NULL on real hardware.
+  SimulatedGPIO *simulation() const { return simulation_; }
+
   // Initialize outputs.
   // Returns the bits that were available and could be set for output.
   // (never use the optional adafruit_hack_needed parameter, it is used
@@ -54,6 +177,10 @@ class GPIO {
   // Set the bits that are '1' in the output. Leave the rest untouched.
   inline void SetBits(uint32_t value) {
     if (!value) return;
+    if (simulation_) {
+      simulation_->SetBits(value);
+      return;
+    }
     *gpio_set_bits_ = value;
     for (int i = 0; i < slowdown_; ++i) {
       *gpio_set_bits_ = value;
@@ -63,6 +190,10 @@ class GPIO {
   // Clear the bits that are '1' in the output. Leave the rest untouched.
   inline void ClearBits(uint32_t value) {
     if (!value) return;
+    if (simulation_) {
+      simulation_->ClearBits(value);
+      return;
+    }
     *gpio_clr_bits_ = value;
     for (int i = 0; i < slowdown_; ++i) {
       *gpio_clr_bits_ = value;
@@ -73,18 +204,26 @@ class GPIO {
   inline void WriteMaskedBits(uint32_t value, uint32_t mask) {
     // Writing a word is two operations. The IO is actually pretty slow, so
     // this should probably  be unnoticable.
+    if (simulation_) {
+      simulation_->WriteMaskedBits(value, mask);
+      return;
+    }
     ClearBits(~value & mask);
     SetBits(value & mask);
   }
 
   inline void Write(uint32_t value) { WriteMaskedBits(value, output_bits_); }
-  inline uint32_t Read() const { return *gpio_read_bits_ & input_bits_; }
+  inline uint32_t Read() const {
+    return (simulation_ ? simulation_->Read() : *gpio_read_bits_)
+      & input_bits_;
+  }
 
  private:
   uint32_t output_bits_;
   uint32_t input_bits_;
   uint32_t reserved_bits_;
   int slowdown_;
+  SimulatedGPIO *simulation_;
   volatile uint32_t *gpio_set_bits_;
   volatile uint32_t *gpio_clr_bits_;
   volatile uint32_t *gpio_read_bits_;
@@ -111,6 +250,42 @@ public:
 
   // If SendPulse() is asynchronously implemented, wait for pulse to finish.
   virtual void WaitPulseFinished() {}
+
+  // Record in "stats" how long waiting for pulses took compared to what
+  // was planned: the overshoot histogram for the hardware pulser, the sleep
+  // histogram for the timer based one. NULL to stop recording.
+  static void SetTimingStats(RefreshStats *stats);
+};
+
+// Constants for the waits of the timer based PinPulser, which sleeps with
+// nanosleep() for most of a pulse and busy-waits the rest. The defaults are
+// empirical values for the Raspberry Pi models; the sleep-calibrate tool
+// measures them on the running machine and writes them to the config file
+// that is read when the first PinPulser is created.
+struct SleepTiming {
+  // The config file: $RGB_MATRIX_SLEEP_TIMING if set, otherwise this.
+  static const char kDefaultConfigFile[];
+  static const char *ConfigFile();
+
+  SleepTiming();  // Defaults that don't know about the Pi model.
+
+  // Reads "name=value" lines, '#' starts a comment. Values not in the file
+  // are left as they are. Returns false if the file can't be read; lines it
+  // doesn't understand are reported on stderr.
+  bool Load(const char *filename);
+
+  // Writes all values, preceded by "comment" lines. Returns false on error,
+  // with the reason in errno.
+  bool Save(const char *filename, const char *comment) const;
+
+  // Typical time nanosleep() takes longer than requested. Without the
+  // microsecond timer, sleeps are shortened by this much.
+  int nanosleep_overhead_us;
+
+  // How much earlier than needed we ask nanosleep() to wake up, so that it
+  // is almost never late; the remaining time is busy-waited. At least the
+  // overhead above, up to its 99.999%-ile if there is CPU to spare.
+  int jitter_allowance_us;
 };
 
 // Get rolling over microsecond counter. We get this from a hardware register
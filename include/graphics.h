@@ -9,20 +9,14 @@
 
 #include "canvas.h"
 
+#include <math.h>
 #include <stdint.h>
 #include <stddef.h>
 
 #include <map>
+#include <vector>
 
 namespace rgb_matrix {
-struct Color {
-  Color() : r(0), g(0), b(0) {}
-  Color(uint8_t rr, uint8_t gg, uint8_t bb) : r(rr), g(gg), b(bb) {}
-  uint8_t r;
-  uint8_t g;
-  uint8_t b;
-};
-
 // 2014 Material Design color palette: https://material.io/design/color
 const Color COLOR_BLACK(0, 0, 0);
 const Color COLOR_WHITE(255, 255, 255);
@@ -46,6 +40,72 @@ const Color COLOR_BROWN(121, 85, 72);
 const Color COLOR_GRAY(158, 158, 158);
 const Color COLOR_BLUE_GRAY(96, 125, 139);
 
+// Maps values to the colors of a gradient. The gradient is precomputed into a
+// lookup table, so mapping a linear or logarithmic value costs one index
+// computation and one table read.
+class ColorRamp {
+public:
+  enum Scale {
+    SCALE_LINEAR,    // Evenly over the range.
+    SCALE_LOG,       // Evenly over log(1 + value); for counts over decades.
+    SCALE_QUANTILE   // Evenly over the ranks of a set of sample values.
+  };
+
+  // A yellow to red gradient with 256 entries over 0..1, linear.
+  ColorRamp();
+
+  // Set the gradient through "stops", which are spread evenly over the
+  // table of "table_size" entries (e.g. 256 or 1024). Needs at least one
+  // stop.
+  void SetGradient(const std::vector<Color> &stops, int table_size = 256);
+
+  // Set the gradient from a comma-separated list of stops. Each stop is
+  // either the name of one of the COLOR_ constants above in lower case with
+  // dashes ("deep-orange"), or a hex color "rrggbb" with an optional "#".
+  // Returns false and leaves the gradient unchanged if "spec" is not valid.
+  bool ParseGradient(const char *spec, int table_size = 256);
+
+  // Spread the gradient over "min_value".."max_value" with SCALE_LINEAR or
+  // SCALE_LOG. Values outside the range get the first or last color.
+  void SetRange(float min_value, float max_value, Scale scale);
+
+  // Spread the gradient evenly over the ranks of "values" (SCALE_QUANTILE),
+  // so every color is used by about as many of them. Equal values share the
+  // color of their middle rank; other values get the color of the next
+  // smaller sample. Mapping a value then is a binary search over the
+  // distinct samples.
+  void SetQuantiles(const float *values, size_t count);
+
+  // Color for "value".
+  const Color &Map(float value) const {
+    if (scale_ == SCALE_QUANTILE) return table_[QuantileIndex(value)];
+    const float x = (scale_ == SCALE_LOG) ? log1pf(fmaxf(value, 0)) : value;
+    const float i = (x - offset_) * factor_;
+    if (!(i > 0)) return table_.front();  // Also NaN.
+    return i < last_index_ ? table_[(int)(i + 0.5f)] : table_.back();
+  }
+
+  int table_size() const { return table_.size(); }
+  const Color &color(int index) const { return table_[index]; }
+  Scale scale() const { return scale_; }
+
+private:
+  int QuantileIndex(float value) const;
+
+  std::vector<Color> table_;
+  float last_index_;  // table_size() - 1.
+  Scale scale_;
+
+  // Linear and log: the table index is (x - offset_) * factor_.
+  float offset_;
+  float factor_;
+
+  // Quantile: the distinct sample values in ascending order and the middle
+  // rank of each of them, scaled to 0..1.
+  std::vector<float> quantiles_;
+  std::vector<float> quantile_ranks_;
+};
+
 // Font loading bdf files. If this ever becomes more types, just make virtual
 // base class.
 class Font {
@@ -123,6 +183,8 @@ private:
 //
 // If "is_bgr" is true, the buffer is treated as BGR pixel arrangement instead
 // of RGB.
+// A FrameCanvas is written with FrameCanvas::SetImageBulk(), which is a lot
+// faster than a SetPixel() per pixel.
 // Returns 'true' if image was shown within canvas.
 bool SetImage(Canvas *c, int canvas_offset_x, int canvas_offset_y,
               const uint8_t *image_buffer, size_t buffer_size_bytes,
@@ -38,6 +38,19 @@ struct RGBLedMatrix;
 struct LedCanvas;
 struct LedFont;
 
+/** A pixel position, for led_canvas_set_pixels() and friends. */
+struct LedPoint {
+  int x;
+  int y;
+};
+
+/** A 24bpp color, for led_canvas_set_pixels(). */
+struct LedColor {
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+};
+
 /**
  * Parameters to create a new matrix.
  *
@@ -151,6 +164,31 @@ struct RGBLedMatrixOptions {
    * to keep a constant refresh rate. <= 0 for no limit.
    */
   int limit_refresh_rate_hz;     /* Corresponding flag: --led-limit-refresh */
+
+  /* Adapt PWM bits and dither bits at runtime to keep the refresh rate at
+   * or above this. <= 0 for fixed bits.
+   */
+  int target_refresh_rate_hz;   /* Corresponding flag: --led-target-refresh */
+
+  /* Name of a shared memory block in which the refresh thread keeps
+   * statistics about frame times, or NULL for none.
+   */
+  const char *refresh_stats_name;  /* Corresponding flag: --led-refresh-stats */
+
+  /* Store only the color bits of each pixel and expand them while
+   * refreshing; less memory and cheaper frame copies.
+   */
+  char packed_framebuffer;  /* Corresponding flag: --led-packed-framebuffer */
+
+  /* Red, green and blue brightness in percent as "<red>,<green>,<blue>",
+   * or NULL for 100 each.
+   */
+  const char *white_balance;  /* Corresponding flag: --led-white-balance */
+
+  /* Gamma curves instead of the CIE1931 luminance correction, as "<gamma>"
+   * or "<red>,<green>,<blue>", or NULL for CIE1931.
+   */
+  const char *gamma;  /* Corresponding flag: --led-gamma */
 };
 
 /**
@@ -237,12 +275,37 @@ void led_canvas_get_size(const struct LedCanvas *canvas,
 void led_canvas_set_pixel(struct LedCanvas *canvas, int x, int y,
                           uint8_t r, uint8_t g, uint8_t b);
 
+/**
+ * Set "count" pixels at once; pixel i is at points[i] with color colors[i].
+ * Much faster than led_canvas_set_pixel() per pixel if colors repeat.
+ * Points outside the canvas are skipped.
+ */
+void led_canvas_set_pixels(struct LedCanvas *canvas,
+                           const struct LedPoint *points,
+                           const struct LedColor *colors, int count);
+
+/** Set "count" pixels at "points" to color (r,g,b). */
+void led_canvas_fill_pixels(struct LedCanvas *canvas,
+                            const struct LedPoint *points, int count,
+                            uint8_t r, uint8_t g, uint8_t b);
+
+/** Set "width" pixels starting at (x, y) to the right to color (r,g,b). */
+void led_canvas_fill_span(struct LedCanvas *canvas, int x, int y, int width,
+                          uint8_t r, uint8_t g, uint8_t b);
+
 /** Clear screen (black). */
 void led_canvas_clear(struct LedCanvas *canvas);
 
 /** Fill matrix with given color. */
 void led_canvas_fill(struct LedCanvas *canvas, uint8_t r, uint8_t g, uint8_t b);
 
+/**
+ * Precompute the GPIO output of the canvas for content that stays up for a
+ * long time; see FrameCanvas::Compile(). Only for a canvas that is not
+ * shown right now. Returns 0 if the matrix has no GPIO.
+ */
+int led_canvas_compile(struct LedCanvas *canvas);
+
 /*** API to provide double-buffering. ***/
 
 /**
@@ -269,6 +332,10 @@ struct LedCanvas *led_matrix_swap_on_vsync(struct RGBLedMatrix *matrix,
 uint8_t led_matrix_get_brightness(struct RGBLedMatrix *matrix);
 void led_matrix_set_brightness(struct RGBLedMatrix *matrix, uint8_t brightness);
 
+/* The PWM bits and dither bits currently shown; see target_refresh_rate_hz. */
+void led_matrix_get_active_pwm_bits(struct RGBLedMatrix *matrix,
+                                    int *pwm_bits, int *dither_bits);
+
 // Utility function: set an image from the given buffer containting pixels.
 //
 // Draw image of size "image_width" and "image_height" from pixel at
@@ -287,6 +354,9 @@ void led_matrix_set_brightness(struct RGBLedMatrix *matrix, uint8_t brightness);
 //
 // If "is_bgr" is 1, the buffer is treated as BGR pixel arrangement instead
 // of RGB with is_bgr = 0.
+//
+// Whole rows are converted at once, which is much faster than calling
+// led_canvas_set_pixel() for each pixel.
 void set_image(struct LedCanvas *c, int canvas_offset_x, int canvas_offset_y,
                const uint8_t *image_buffer, size_t buffer_size_bytes,
                int image_width, int image_height,
@@ -154,6 +154,35 @@ public:
     // Limit refresh rate of LED panel. This will help on a loaded system
     // to keep a constant refresh rate. <= 0 for no limit.
     int limit_refresh_rate_hz;   // Flag: --led-limit-refresh
+
+    // If set, the refresh thread keeps statistics about frame times in the
+    // shared memory block with this name; see refresh-stats.h.
+    // NULL or empty for none.
+    const char *refresh_stats_name;   // Flag: --led-refresh-stats
+
+    // Keep the refresh rate at or above this by lowering the PWM bits and
+    // then raising the dither bits while the refresh thread can't make it,
+    // and going back up when it can again. pwm_bits and pwm_dither_bits are
+    // where it starts and the best quality it goes back up to.
+    // <= 0 to always use the configured bits.
+    int target_refresh_rate_hz;  // Flag: --led-target-refresh
+
+    // Store only the color bits of each pixel, a quarter of the memory with
+    // one parallel chain, and expand them to GPIO words while refreshing.
+    // Makes copying frames, Serialize() and content streams that much
+    // cheaper, at some CPU cost in the refresh thread. Streams written
+    // with and without it are not compatible.
+    bool packed_framebuffer;  // Flag: --led-packed-framebuffer
+
+    // Scale red, green and blue separately, in percent of the brightness,
+    // to balance the white of the panels: "<red>,<green>,<blue>", e.g.
+    // "100,85,90". NULL or empty for 100 each.
+    const char *white_balance;  // Flag: --led-white-balance
+
+    // Map colors with gamma curves instead of the CIE1931 luminance
+    // correction: "<gamma>" for all colors or "<red>,<green>,<blue>", e.g.
+    // "2.2". NULL or empty for CIE1931.
+    const char *gamma;  // Flag: --led-gamma
   };
 
   // Create an RGBMatrix.
@@ -228,6 +257,10 @@ public:
   bool SetPWMBits(uint8_t value);
   uint8_t pwmbits();   // return the pwm-bits of the currently active buffer.
 
+  // The PWM bits and dither bits the refresh thread currently shows. They
+  // only differ from the configured ones with Options::target_refresh_rate_hz.
+  void GetActivePWMBits(int *pwm_bits, int *dither_bits);
+
   // Map brightness of output linearly to input with CIE1931 profile.
   void set_luminance_correct(bool on);
   bool luminance_correct() const;
@@ -295,6 +328,17 @@ public:
   // 28Hz animation, nicely locked to the frame-rate).
   FrameCanvas *SwapOnVSync(FrameCanvas *other, unsigned framerate_fraction = 1);
 
+  // Triple-buffered alternative to SwapOnVSync() that never blocks: hands
+  // "frame" to the refresh thread, which shows it from its next frame on,
+  // and immediately returns a FrameCanvas that is not shown, to draw the
+  // next frame into. If frames are published faster than refreshed, only the
+  // newest is shown; the returned canvas is then the skipped one.
+  //
+  // As with SwapOnVSync(), the returned canvas contains an older frame.
+  // The first call creates a third FrameCanvas. Don't mix with SwapOnVSync()
+  // in the same program.
+  FrameCanvas *PublishFrame(FrameCanvas *frame);
+
   // -- Canvas interface. These write to the active FrameCanvas
   // (see documentation in canvas.h)
   virtual int width() const;
@@ -303,6 +347,9 @@ public:
                         uint8_t red, uint8_t green, uint8_t blue);
   virtual void Clear();
   virtual void Fill(uint8_t red, uint8_t green, uint8_t blue);
+  virtual void SetPixels(const Point *points, const Color *colors, int count);
+  virtual void FillPixels(const Point *points, int count, const Color &color);
+  virtual void FillSpan(int x, int y, int width, const Color &color);
 
 private:
   class UpdateThread;
@@ -365,6 +412,59 @@ public:
   // Copy content from other FrameCanvas owned by the same RGBMatrix.
   void CopyFrom(const FrameCanvas &other);
 
+  //-- Partial updates.
+  // The canvas keeps track of the parts of its internal representation that
+  // were written since the last MarkClean() (or since creation). A producer
+  // that changes only a few pixels per frame can bring the canvas it gets
+  // back from SwapOnVSync() up to date by copying just those parts:
+  //
+  //   offscreen->MarkClean();
+  //   ... draw the changes into offscreen ...
+  //   FrameCanvas *previous = offscreen;
+  //   offscreen = matrix->SwapOnVSync(offscreen);
+  //   offscreen->CopyDirtyFrom(*previous);   // now same content again.
+  void MarkClean();
+
+  // Number of bytes written since the last MarkClean(); zero if nothing
+  // changed, and what CopyDirtyFrom() copies from this canvas.
+  size_t DirtySize() const;
+
+  // Like CopyFrom(), but only copies the parts written in "other" since its
+  // last MarkClean(). The rest of this canvas stays as it is. Marks the
+  // copied parts dirty in this canvas as well.
+  void CopyDirtyFrom(const FrameCanvas &other);
+
+  //-- Static content.
+  // Precompute everything the refresh thread writes to the GPIO to show the
+  // current content, including row addresses and strobes, so that showing
+  // the canvas is just a walk through the prepared words. Worth it for
+  // content that stays up for a long time, like a map that changes once a
+  // day. Takes about as much memory again as the canvas. Any drawing or
+  // SetPWMBits() afterwards goes back to the normal output until the next
+  // Compile().
+  // Only call on a canvas that is not shown right now, e.g. before
+  // SwapOnVSync(). Returns false if the matrix has no GPIO.
+  bool Compile();
+
+  // Keep the bitplane words of recently used colors in a small cache for
+  // SetPixel() and SetPixels(). This can help content with few colors on
+  // slow CPUs; the statistics below show whether it hits. Off by default.
+  void set_color_cache(bool on);
+  bool color_cache() const;
+
+  // Color cache hits and misses since the last reset.
+  void GetColorCacheStats(uint64_t *hits, uint64_t *misses) const;
+  void ResetColorCacheStats();
+
+  // Set a "width" x "height" block of pixels with the top left corner at
+  // "x","y" from an image with rows of 3-byte RGB (or BGR if "is_bgr")
+  // pixels, each row "stride" bytes after the previous. Parts outside the
+  // canvas are cropped.
+  // Same result as SetPixel() for each pixel, but a lot faster for large
+  // images; SetImage() in graphics.h uses this for a FrameCanvas.
+  void SetImageBulk(int x, int y, int width, int height,
+                    const uint8_t *image, size_t stride, bool is_bgr);
+
   // -- Canvas interface.
   virtual int width() const;
   virtual int height() const;
@@ -372,6 +472,9 @@ public:
                         uint8_t red, uint8_t green, uint8_t blue);
   virtual void Clear();
   virtual void Fill(uint8_t red, uint8_t green, uint8_t blue);
+  virtual void SetPixels(const Point *points, const Color *colors, int count);
+  virtual void FillPixels(const Point *points, int count, const Color &color);
+  virtual void FillSpan(int x, int y, int width, const Color &color);
 
 private:
   friend class RGBMatrix;
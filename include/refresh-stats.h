@@ -0,0 +1,107 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//
+// Statistics the refresh thread keeps about itself, in shared memory so that
+// another process can watch them while the matrix is running. Enable with
+// RGBMatrix::Options::refresh_stats_name (--led-refresh-stats=<name>); the
+// refresh-stats tool in the top-level directory shows them.
+//
+// The refresh thread only does a few relaxed atomic stores per frame, so this
+// can stay enabled in production. All counters are 32 bit and wrap around;
+// readers should look at differences between two snapshots.
+
+#ifndef RPI_REFRESH_STATS_H
+#define RPI_REFRESH_STATS_H
+
+#include <stdint.h>
+
+#include <atomic>
+
+namespace rgb_matrix {
+struct RefreshStats {
+  // Changes whenever the layout below changes.
+  static const uint32_t kMagic = 0x52465332;
+  static const int kFrameBuckets = 128;
+  static const int kOvershootBuckets = 256;
+  static const int kSleepRequestBuckets = 16;
+  static const int kSleepErrorBuckets = 80;
+  static const int kSleepEarlyUs = 16;
+
+  uint32_t magic;
+
+  std::atomic<uint32_t> frame_count;
+  std::atomic<uint32_t> last_frame_us;
+  std::atomic<uint32_t> min_frame_us;   // Not counting the first seconds.
+  std::atomic<uint32_t> max_frame_us;   // Not counting the first seconds.
+
+  // Frames handed to RGBMatrix::PublishFrame() that were replaced by a newer
+  // one before the refresh thread got to show them.
+  std::atomic<uint32_t> missed_swaps;
+
+  // Number of frames by frame time, see FrameBucket().
+  std::atomic<uint32_t> frame_histogram[kFrameBuckets];
+
+  // How many microseconds longer than planned it took to sleep while the
+  // hardware pin pulser sends an output-enable pulse, beyond the allowance
+  // for OS jitter. The last bucket also counts everything longer.
+  std::atomic<uint32_t> overshoot_histogram_us[kOvershootBuckets];
+
+  // How long the waits of the timer based pin pulser took compared to the
+  // requested time, by SleepRequestBucket() and SleepErrorBucket().
+  std::atomic<uint32_t> sleep_histogram[kSleepRequestBuckets]
+                                       [kSleepErrorBuckets];
+
+  // Index into frame_histogram for a frame time of "usec". Buckets are one
+  // microsecond wide up to 8us, then eight buckets per power of two, so
+  // within 12.5% up to the last bucket, which counts everything >= 245ms.
+  static int FrameBucket(uint32_t usec) {
+    if (usec < 8) return usec;
+    const int exponent = 31 - __builtin_clz(usec);
+    const int bucket = 8 * (exponent - 2) + ((usec >> (exponent - 3)) & 7);
+    return bucket < kFrameBuckets ? bucket : kFrameBuckets - 1;
+  }
+
+  // Shortest frame time that is counted in "bucket".
+  static uint32_t BucketStart(int bucket) {
+    if (bucket < 8) return bucket;
+    return (8 + bucket % 8) << (bucket / 8 - 1);
+  }
+
+  // Row of sleep_histogram for a requested wait of "nanos": 0 below 1us,
+  // then one row per power of two, the last for everything >= 16ms.
+  static int SleepRequestBucket(long nanos) {
+    const unsigned long usec = nanos / 1000;
+    if (usec == 0) return 0;
+    const int bucket = 64 - __builtin_clzl(usec);
+    return bucket < kSleepRequestBuckets ? bucket : kSleepRequestBuckets - 1;
+  }
+
+  // Shortest requested time in microseconds that is counted in "bucket".
+  static uint32_t SleepRequestStart(int bucket) {
+    return bucket == 0 ? 0 : 1 << (bucket - 1);
+  }
+
+  // Column of sleep_histogram for a wait that took "error_us" longer than
+  // requested; negative if shorter. The first and last column also count
+  // everything beyond.
+  static int SleepErrorBucket(int error_us) {
+    const int bucket = error_us + kSleepEarlyUs;
+    if (bucket < 0) return 0;
+    return bucket < kSleepErrorBuckets ? bucket : kSleepErrorBuckets - 1;
+  }
+
+  // Creates the shared memory block "name" (a name in /dev/shm; a leading
+  // slash is optional) or resets it if it exists. Returns NULL on error, with
+  // the reason in errno.
+  static RefreshStats *Create(const char *name);
+
+  // Opens the block "name" read-only to watch it. Returns NULL if it does
+  // not exist or is not from a compatible version of the library.
+  static const RefreshStats *Open(const char *name);
+
+  // Unmaps a block returned by Create() or Open(). The shared memory stays,
+  // so that the last state can still be looked at.
+  static void Close(const RefreshStats *stats);
+};
+}  // namespace rgb_matrix
+
+#endif  // RPI_REFRESH_STATS_H
@@ -20,6 +20,8 @@
 #include "thread.h"
 #include "canvas.h"
 
+#include <atomic>
+
 namespace rgb_matrix {
 //
 // Typically, your programs will crate a canvas and then updating the image
@@ -62,17 +64,13 @@ public:
   virtual ~ThreadedCanvasManipulator() {  Stop(); }
 
   virtual void Start(int realtime_priority=0, uint32_t affinity_mask=0) {
-    {
-      MutexLock l(&mutex_);
-      running_ = true;
-    }
+    running_.store(true, std::memory_order_release);
     Thread::Start(realtime_priority, affinity_mask);
   }
 
   // Stop the thread at the next possible time Run() checks the running_ flag.
   void Stop() {
-    MutexLock l(&mutex_);
-    running_ = false;
+    running_.store(false, std::memory_order_release);
   }
 
   // Implement this and run while running() returns true.
@@ -81,13 +79,11 @@ public:
 protected:
   inline Canvas *canvas() { return canvas_; }
   inline bool running() {
-    MutexLock l(&mutex_);
-    return running_;
+    return running_.load(std::memory_order_acquire);
   }
 
 private:
-  Mutex mutex_;
-  bool running_;
+  std::atomic<bool> running_;
   Canvas *const canvas_;
 };
 }  // namespace rgb_matrix
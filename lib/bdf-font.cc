@@ -159,6 +159,10 @@ int Font::CharacterWidth(uint32_t unicode_codepoint) const {
   return g ? g->device_width : -1;
 }
 
+static inline bool IsPixelSet(rowbitmap_t row, int x) {
+  return x < 64 && (row >> (63 - x)) & 1;
+}
+
 int Font::DrawGlyph(Canvas *c, int x_pos, int y_pos,
                     const Color &color, const Color *bgcolor,
                     uint32_t unicode_codepoint) const {
@@ -168,13 +172,20 @@ int Font::DrawGlyph(Canvas *c, int x_pos, int y_pos,
   y_pos = y_pos - g->height - g->y_offset;
   for (int y = 0; y < g->height; ++y) {
     const rowbitmap_t row = g->bitmap[y];
-    rowbitmap_t x_mask = (1LL<<63);
-    for (int x = 0; x < g->device_width; ++x, x_mask >>= 1) {
-      if (row & x_mask) {
-        c->SetPixel(x_pos + x, y_pos + y, color.r, color.g, color.b);
+    // Draw runs of set (or, with background, unset) bits as spans.
+    int x = 0;
+    while (x < g->device_width) {
+      const bool is_set = IsPixelSet(row, x);
+      int end = x + 1;
+      while (end < g->device_width && IsPixelSet(row, end) == is_set) {
+        ++end;
+      }
+      if (is_set) {
+        c->FillSpan(x_pos + x, y_pos + y, end - x, color);
       } else if (bgcolor) {
-        c->SetPixel(x_pos + x, y_pos + y, bgcolor->r, bgcolor->g, bgcolor->b);
+        c->FillSpan(x_pos + x, y_pos + y, end - x, *bgcolor);
       }
+      x = end;
     }
   }
   return g->device_width;
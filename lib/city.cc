@@ -2,11 +2,108 @@
 
 using namespace std;
 
-City::City(string name, string state, float lng, float lat, int x, int y) {
-    this->name = name;
-    this->state = state;
-    this->lng = lng;
-    this->lat = lat;
-    this->x = x;
-    this->y = y;
-}
\ No newline at end of file
+int CityTable::Add(string_view name, string_view state, float lng, float lat,
+    int population) {
+    lng_.push_back(lng);
+    lat_.push_back(lat);
+    x_.push_back(0);
+    y_.push_back(0);
+    state_id_.push_back(InternState(state));
+    population_.push_back(population);
+    names_.append(name);
+    name_start_.push_back(names_.size());
+    return lng_.size() - 1;
+}
+
+void CityTable::Reserve(size_t n) {
+    lng_.reserve(n);
+    lat_.reserve(n);
+    x_.reserve(n);
+    y_.reserve(n);
+    state_id_.reserve(n);
+    population_.reserve(n);
+    name_start_.reserve(n + 1);
+}
+
+void CityTable::Clear() {
+    lng_.clear();
+    lat_.clear();
+    x_.clear();
+    y_.clear();
+    state_id_.clear();
+    population_.clear();
+    names_.clear();
+    name_start_.assign(1, 0);
+    states_.clear();
+    state_ids_.clear();
+}
+
+int CityTable::StateId(string_view state) const {
+    unordered_map<string, uint8_t>::const_iterator it =
+        state_ids_.find(string(state));
+    return it == state_ids_.end() ? -1 : it->second;
+}
+
+int CityTable::InternState(string_view state) {
+    int id = StateId(state);
+    if (id >= 0)
+        return id;
+    if (states_.size() > UINT8_MAX)
+        return UINT8_MAX;  // Out of ids; should not happen for US states.
+    id = states_.size();
+    states_.push_back(string(state));
+    state_ids_[states_.back()] = id;
+    return id;
+}
+
+void CityIndex::BuildNameIndex(const CityTable &cities) {
+    cities_ = &cities;
+    by_name_.assign(cities.state_count(), unordered_map<string_view, int>());
+    for (size_t i = 0; i < cities.size(); i++)
+        by_name_[cities.state_id(i)].emplace(cities.name(i), i);
+}
+
+void CityIndex::BuildPixelIndex(const CityTable &cities, int width,
+    int height) {
+    width_ = width;
+    height_ = height;
+    const int16_t *xs = cities.xs();
+    const int16_t *ys = cities.ys();
+
+    // Counting sort of the cities by pixel.
+    pixel_start_.assign(size_t(width) * height + 1, 0);
+    for (size_t i = 0; i < cities.size(); i++) {
+        if (xs[i] >= 0 && xs[i] < width && ys[i] >= 0 && ys[i] < height)
+            pixel_start_[ys[i] * width + xs[i] + 1]++;
+    }
+    for (size_t p = 1; p < pixel_start_.size(); p++)
+        pixel_start_[p] += pixel_start_[p - 1];
+
+    pixel_cities_.resize(pixel_start_.back());
+    vector<int> next(pixel_start_.begin(), pixel_start_.end() - 1);
+    for (size_t i = 0; i < cities.size(); i++) {
+        if (xs[i] >= 0 && xs[i] < width && ys[i] >= 0 && ys[i] < height)
+            pixel_cities_[next[ys[i] * width + xs[i]]++] = i;
+    }
+}
+
+int CityIndex::Find(string_view state, string_view name) const {
+    if (cities_ == NULL)
+        return -1;
+    int state_id = cities_->StateId(state);
+    if (state_id < 0 || state_id >= int(by_name_.size()))
+        return -1;
+    unordered_map<string_view, int>::const_iterator it =
+        by_name_[state_id].find(name);
+    return it == by_name_[state_id].end() ? -1 : it->second;
+}
+
+const int *CityIndex::AtPixel(int x, int y, int *count) const {
+    if (x < 0 || x >= width_ || y < 0 || y >= height_) {
+        *count = 0;
+        return NULL;
+    }
+    const int p = y * width_ + x;
+    *count = pixel_start_[p + 1] - pixel_start_[p];
+    return pixel_cities_.data() + pixel_start_[p];
+}
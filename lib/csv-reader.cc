@@ -0,0 +1,132 @@
+#include "csv-reader.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const size_t INITIAL_BUFFER_SIZE = 64 * 1024;
+
+void SplitCSVRecord(char *begin, char *end, vector<string_view> *fields) {
+    fields->clear();
+    if (end > begin && end[-1] == '\n')
+        end--;
+    if (end > begin && end[-1] == '\r')
+        end--;
+
+    char *p = begin;
+    for (;;) {
+        char *start = p;
+        char *out = p;
+        if (p < end && *p == '"') {
+            // Unquote in place; the result is never longer than the input.
+            p++;
+            while (p < end) {
+                if (*p == '"') {
+                    if (p + 1 < end && p[1] == '"') {
+                        *out++ = '"';
+                        p += 2;
+                        continue;
+                    }
+                    p++;
+                    break;
+                }
+                *out++ = *p++;
+            }
+            // Keep anything between the closing quote and the comma.
+            while (p < end && *p != ',')
+                *out++ = *p++;
+        } else {
+            while (p < end && *p != ',')
+                p++;
+            out = p;
+        }
+        fields->push_back(string_view(start, out - start));
+        const bool last = (p >= end);
+        *out = '\0';  // At or before the comma, which we are done with.
+        if (last)
+            return;
+        p++;  // Skip the comma.
+    }
+}
+
+CSVReader::CSVReader() : fd_(-1), eof_(true), begin_(0), end_(0) {
+}
+
+CSVReader::~CSVReader() {
+    Close();
+}
+
+bool CSVReader::Open(const char *path) {
+    Close();
+    fd_ = open(path, O_RDONLY);
+    if (fd_ < 0)
+        return false;
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    if (buffer_.empty())
+        buffer_.resize(INITIAL_BUFFER_SIZE);
+    eof_ = false;
+    begin_ = end_ = 0;
+    return true;
+}
+
+void CSVReader::Close() {
+    if (fd_ >= 0)
+        close(fd_);
+    fd_ = -1;
+    eof_ = true;
+    begin_ = end_ = 0;
+    fields_.clear();
+}
+
+bool CSVReader::Fill() {
+    if (eof_)
+        return false;
+    if (begin_ > 0) {
+        memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+        end_ -= begin_;
+        begin_ = 0;
+    }
+    // Keep one byte spare to NUL-terminate a last record without newline.
+    if (end_ + 1 >= buffer_.size())
+        buffer_.resize(2 * buffer_.size());  // A record longer than the buffer.
+    ssize_t r = read(fd_, buffer_.data() + end_, buffer_.size() - 1 - end_);
+    if (r <= 0) {
+        eof_ = true;
+        return false;
+    }
+    end_ += r;
+    return true;
+}
+
+bool CSVReader::NextRecord() {
+    fields_.clear();
+    size_t scan = begin_;
+    bool in_quotes = false;
+    for (;;) {
+        // Find the end of the record; newlines inside quotes do not count.
+        const char *data = buffer_.data();
+        for (; scan < end_; scan++) {
+            if (data[scan] == '"')
+                in_quotes = !in_quotes;
+            else if (data[scan] == '\n' && !in_quotes)
+                break;
+        }
+        if (scan < end_) {
+            scan++;  // Include the newline.
+            break;
+        }
+        size_t offset = scan - begin_;
+        if (!Fill()) {
+            if (begin_ == end_)
+                return false;
+            scan = end_;  // Last record without a trailing newline.
+            break;
+        }
+        scan = begin_ + offset;
+    }
+    SplitCSVRecord(buffer_.data() + begin_, buffer_.data() + scan, &fields_);
+    begin_ = scan;
+    return true;
+}
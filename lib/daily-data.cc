@@ -0,0 +1,283 @@
+#include "daily-data.h"
+#include "csv-reader.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The file is written in host byte order; the magic value doubles as an
+// endianness check.
+static const uint32_t DAILY_MAGIC = 0x31594C44;  // "DLY1"
+
+struct DailyFileHeader {
+    uint32_t magic;
+    uint32_t n_columns;
+    uint32_t n_states;
+    uint32_t n_dates;
+    uint32_t n_rows;
+    uint32_t reserved;
+};
+// The header is followed by
+//   n_states state codes of STATE_CODE_SIZE bytes,
+//   n_dates DailyDateIndex entries sorted by date,
+//   n_rows state ids, padded to a multiple of 4 bytes,
+//   n_columns arrays of n_rows int32_t values.
+
+struct DailyDateIndex {
+    uint32_t date;
+    uint32_t first_row;
+    uint32_t n_rows;
+};
+
+static const size_t STATE_CODE_SIZE = 4;
+
+// Column names in the CSV header, indexed by DailyColumn.
+static const char *CSV_COLUMN_NAMES[DAILY_N_COLUMNS] = {
+    "positive", "negative", "death", "positiveIncrease", "deathIncrease"
+};
+
+static size_t padded_size(size_t n) { return (n + 3) & ~size_t(3); }
+
+static size_t file_size(const DailyFileHeader &h) {
+    return sizeof(DailyFileHeader)
+        + h.n_states * STATE_CODE_SIZE
+        + h.n_dates * sizeof(DailyDateIndex)
+        + padded_size(h.n_rows)
+        + size_t(h.n_columns) * h.n_rows * sizeof(int32_t);
+}
+
+namespace {
+struct CSVRow {
+    uint32_t date;
+    int state_id;
+    int32_t values[DAILY_N_COLUMNS];
+
+    bool operator<(const CSVRow &other) const {
+        if (date != other.date)
+            return date < other.date;
+        return state_id < other.state_id;
+    }
+};
+}
+
+bool ConvertDailyCSV(const char *csv_path, const char *bin_path) {
+    CSVReader csv;
+    if (!csv.Open(csv_path) || !csv.NextRecord())
+        return false;
+
+    // Locate the columns we keep by their name in the header.
+    int date_column = -1, state_column = -1;
+    int value_columns[DAILY_N_COLUMNS];
+    fill(value_columns, value_columns + DAILY_N_COLUMNS, -1);
+    for (size_t i = 0; i < csv.field_count(); i++) {
+        if (csv.field(i) == "date")
+            date_column = i;
+        else if (csv.field(i) == "state")
+            state_column = i;
+        for (int c = 0; c < DAILY_N_COLUMNS; c++) {
+            if (csv.field(i) == CSV_COLUMN_NAMES[c])
+                value_columns[c] = i;
+        }
+    }
+    if (date_column < 0 || state_column < 0) {
+        fprintf(stderr, "%s: missing date or state column.\n", csv_path);
+        return false;
+    }
+    size_t max_column = max(date_column, state_column);
+    for (int c = 0; c < DAILY_N_COLUMNS; c++) {
+        if (value_columns[c] < 0) {
+            fprintf(stderr, "%s: missing column '%s'.\n", csv_path,
+                CSV_COLUMN_NAMES[c]);
+            return false;
+        }
+        max_column = max(max_column, size_t(value_columns[c]));
+    }
+
+    vector<CSVRow> rows;
+    vector<string> row_states;
+    map<string, int> state_ids;
+    while (csv.NextRecord()) {
+        if (csv.field_count() <= max_column)
+            continue;
+        CSVRow row;
+        row.date = strtoul(csv.field(date_column).data(), NULL, 10);
+        for (int c = 0; c < DAILY_N_COLUMNS; c++)
+            row.values[c] = strtol(csv.field(value_columns[c]).data(), NULL, 10);
+        string state(csv.field(state_column));
+        rows.push_back(row);
+        row_states.push_back(state);
+        state_ids[state] = 0;
+    }
+
+    // State ids follow the alphabetical order of the state codes.
+    if (state_ids.size() > 256) {
+        fprintf(stderr, "%s: too many states.\n", csv_path);
+        return false;
+    }
+    vector<char> state_codes(state_ids.size() * STATE_CODE_SIZE, '\0');
+    int next_id = 0;
+    for (map<string, int>::iterator it = state_ids.begin();
+        it != state_ids.end(); it++) {
+        strncpy(&state_codes[next_id * STATE_CODE_SIZE], it->first.c_str(),
+            STATE_CODE_SIZE - 1);
+        it->second = next_id++;
+    }
+    for (size_t i = 0; i < rows.size(); i++)
+        rows[i].state_id = state_ids[row_states[i]];
+    sort(rows.begin(), rows.end());
+
+    vector<DailyDateIndex> dates;
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (dates.empty() || dates.back().date != rows[i].date) {
+            DailyDateIndex entry = { rows[i].date, uint32_t(i), 0 };
+            dates.push_back(entry);
+        }
+        dates.back().n_rows++;
+    }
+
+    DailyFileHeader header = {};
+    header.magic = DAILY_MAGIC;
+    header.n_columns = DAILY_N_COLUMNS;
+    header.n_states = state_ids.size();
+    header.n_dates = dates.size();
+    header.n_rows = rows.size();
+
+    vector<uint8_t> ids(padded_size(rows.size()), 0);
+    vector<int32_t> values(DAILY_N_COLUMNS * rows.size());
+    for (size_t i = 0; i < rows.size(); i++) {
+        ids[i] = rows[i].state_id;
+        for (int c = 0; c < DAILY_N_COLUMNS; c++)
+            values[c * rows.size() + i] = rows[i].values[c];
+    }
+
+    // Write to a temporary file first so that readers never see a partially
+    // written file.
+    string tmp_path = string(bin_path) + ".tmp";
+    FILE *out = fopen(tmp_path.c_str(), "wb");
+    if (out == NULL) {
+        perror(tmp_path.c_str());
+        return false;
+    }
+    bool success = fwrite(&header, sizeof(header), 1, out) == 1
+        && fwrite(state_codes.data(), 1, state_codes.size(), out)
+            == state_codes.size()
+        && fwrite(dates.data(), sizeof(DailyDateIndex), dates.size(), out)
+            == dates.size()
+        && fwrite(ids.data(), 1, ids.size(), out) == ids.size()
+        && fwrite(values.data(), sizeof(int32_t), values.size(), out)
+            == values.size();
+    success = (fclose(out) == 0) && success;
+    if (!success || rename(tmp_path.c_str(), bin_path) != 0) {
+        perror(bin_path);
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+DailyData::DailyData()
+    : mapping_(NULL), mapping_size_(0), header_(NULL), state_codes_(NULL),
+      dates_(NULL), state_ids_(NULL), columns_(NULL) {
+}
+
+DailyData::~DailyData() {
+    Close();
+}
+
+bool DailyData::Open(const char *path) {
+    Close();
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(DailyFileHeader)) {
+        close(fd);
+        return false;
+    }
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+    mapping_ = mapping;
+    mapping_size_ = st.st_size;
+
+    const DailyFileHeader *header = (const DailyFileHeader *) mapping;
+    if (header->magic != DAILY_MAGIC || header->n_columns != DAILY_N_COLUMNS
+        || file_size(*header) != mapping_size_) {
+        Close();
+        return false;
+    }
+
+    const char *p = (const char *) mapping + sizeof(DailyFileHeader);
+    header_ = header;
+    state_codes_ = p;
+    p += header->n_states * STATE_CODE_SIZE;
+    dates_ = (const DailyDateIndex *) p;
+    p += header->n_dates * sizeof(DailyDateIndex);
+    state_ids_ = (const uint8_t *) p;
+    p += padded_size(header->n_rows);
+    columns_ = (const int32_t *) p;
+    return true;
+}
+
+void DailyData::Close() {
+    if (mapping_ != NULL)
+        munmap(mapping_, mapping_size_);
+    mapping_ = NULL;
+    mapping_size_ = 0;
+    header_ = NULL;
+}
+
+int DailyData::date_count() const {
+    return header_ ? header_->n_dates : 0;
+}
+
+int DailyData::state_count() const {
+    return header_ ? header_->n_states : 0;
+}
+
+uint32_t DailyData::date(int date_index) const {
+    return dates_[date_index].date;
+}
+
+const char *DailyData::state_code(int state_id) const {
+    return state_codes_ + state_id * STATE_CODE_SIZE;
+}
+
+int DailyData::FindDate(uint32_t yyyymmdd) const {
+    int low = 0, high = date_count();
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (dates_[mid].date < yyyymmdd)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low < date_count() && dates_[low].date == yyyymmdd)
+        return low;
+    return -1;
+}
+
+int DailyData::row_count(int date_index) const {
+    return dates_[date_index].n_rows;
+}
+
+const uint8_t *DailyData::state_ids(int date_index) const {
+    return state_ids_ + dates_[date_index].first_row;
+}
+
+const int32_t *DailyData::values(DailyColumn column, int date_index) const {
+    return columns_ + size_t(column) * header_->n_rows
+        + dates_[date_index].first_row;
+}
@@ -18,6 +18,10 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <atomic>
+#include <string>
+
+#include "canvas.h"
 #include "hardware-mapping.h"
 
 namespace rgb_matrix {
@@ -26,48 +30,93 @@ class PinPulser;
 namespace internal {
 class RowAddressSetter;
 
-// An opaque type used within the framebuffer that can be used
-// to copy between PixelMappers.
-struct PixelDesignator {
-  PixelDesignator() : gpio_word(-1), r_bit(0), g_bit(0), b_bit(0), mask(~0){}
-  int gpio_word;
+enum {
+  kBitPlanes = 11,     // maximum usable bitplanes, i.e. PWM bits.
+  kMaxDitherBits = 2   // maximum number of time dithered low bits.
+};
+
+// The gpio bits for the red, green and blue of a pixel and the mask to clear
+// them. These only depend on the half of the panel and the parallel chain.
+struct PixelColorBits {
+  PixelColorBits() : r_bit(0), g_bit(0), b_bit(0), mask(~0) {}
   uint32_t r_bit;
   uint32_t g_bit;
   uint32_t b_bit;
   uint32_t mask;
 };
 
+// Corrections of red, green and blue on top of brightness and luminance
+// correction, see RGBMatrix::Options::white_balance and gamma.
+struct ColorCorrection {
+  ColorCorrection();
+  // Parse the strings of the Options; NULL or empty for the defaults.
+  // Returns false and appends the reason to "err" if they are invalid.
+  bool Parse(const char *white_balance, const char *gamma, std::string *err);
+
+  float white_balance[3];  // Percent of the brightness.
+  float gamma[3];          // Exponent of a gamma curve; 0 for CIE1931.
+};
+
+// An opaque type used within the framebuffer that can be used
+// to copy between PixelMappers. The offset of the pixel in the lowest
+// bitplane, shifted left by kColorBitsIndexBits, and the index of its
+// PixelColorBits in the PixelDesignatorMap. Zero for a pixel not shown.
+typedef uint32_t PixelDesignator;
+
 class PixelDesignatorMap {
 public:
-  PixelDesignatorMap(int width, int height, const PixelDesignator &fill_bits);
+  enum {
+    kColorBitsIndexBits = 4,
+    kMaxColorBits = 1 << kColorBitsIndexBits  // Including the unused pixel.
+  };
+
+  PixelDesignatorMap(int width, int height, const PixelColorBits &fill_bits);
+  // A map of a different size with the color bits of "other", to copy its
+  // PixelDesignators into.
+  PixelDesignatorMap(int width, int height, const PixelDesignatorMap &other);
   ~PixelDesignatorMap();
 
   // Get a writable version of the PixelDesignator. Outside Framebuffer used
   // by the RGBMatrix to re-assign mappings to new PixelDesignatorMappers.
   PixelDesignator *get(int x, int y);
 
+  // The PixelDesignator for the pixel at "gpio_word" with color "bits".
+  PixelDesignator Designate(int gpio_word, const PixelColorBits &bits);
+
+  static bool IsUsed(PixelDesignator d) {
+    return (d & (kMaxColorBits - 1)) != 0;
+  }
+  static int GpioWord(PixelDesignator d) { return d >> kColorBitsIndexBits; }
+  const PixelColorBits &ColorBits(PixelDesignator d) const {
+    return color_bits_[d & (kMaxColorBits - 1)];
+  }
+
   inline int width() const { return width_; }
   inline int height() const { return height_; }
 
   // All bits that set red/green/blue pixels; used for Fill().
-  const PixelDesignator &GetFillColorBits() { return fill_bits_; }
+  const PixelColorBits &GetFillColorBits() { return fill_bits_; }
 
 private:
   const int width_;
   const int height_;
-  const PixelDesignator fill_bits_;  // Precalculated for fill.
+  const PixelColorBits fill_bits_;  // Precalculated for fill.
+  PixelColorBits color_bits_[kMaxColorBits];  // [0] for unused pixels.
+  int color_bits_count_;
   PixelDesignator *const buffer_;
 };
 
 // Internal representation of the frame-buffer that as well can
 // write itself to GPIO.
 // Our internal memory layout mimicks as much as possible what needs to be
-// written out.
+// written out. With "packed", only the color bits are stored, a byte per
+// column and parallel chain, and expanded to GPIO words while writing out.
+// All Framebuffers sharing a "mapper" need to agree on "packed".
 class Framebuffer {
 public:
   Framebuffer(int rows, int columns, int parallel,
               int scan_mode,
-              const char* led_sequence, bool inverse_color,
+              const char* led_sequence, bool inverse_color, bool packed,
               PixelDesignatorMap **mapper);
   ~Framebuffer();
 
@@ -76,7 +125,6 @@ public:
   static void InitGPIO(GPIO *io, int rows, int parallel,
                        bool allow_hardware_pulsing,
                        int pwm_lsb_nanoseconds,
-                       int dither_bits,
                        int row_address_type);
   static void InitializePanels(GPIO *io, const char *panel_type, int columns);
 
@@ -87,33 +135,72 @@ public:
   uint8_t pwmbits() { return pwm_bits_; }
 
   // Map brightness of output linearly to input with CIE1931 profile.
-  void set_luminance_correct(bool on) { do_luminance_correct_ = on; }
+  void set_luminance_correct(bool on);
   bool luminance_correct() const { return do_luminance_correct_; }
 
   // Set brightness in percent; range=1..100
   // This will only affect newly set pixels.
-  void SetBrightness(uint8_t b) {
-    brightness_ = (b <= 100 ? (b != 0 ? b : 1) : 100);
-  }
+  void SetBrightness(uint8_t b);
   uint8_t brightness() { return brightness_; }
 
-  void DumpToMatrix(GPIO *io, int pwm_bits_to_show);
+  // Per-color white balance and gamma curves. Only affects newly set pixels.
+  void SetColorCorrection(const ColorCorrection &correction);
+
+  // Keep the bitplane words of recently used colors in a small cache, used
+  // by SetPixel() and SetPixels(). Off by default.
+  void set_color_cache(bool on);
+  bool color_cache() const { return color_cache_ != NULL; }
+
+  // Hits and misses of the color cache since the last ResetColorCacheStats().
+  void GetColorCacheStats(uint64_t *hits, uint64_t *misses) const {
+    *hits = color_cache_hits_;
+    *misses = color_cache_misses_;
+  }
+  void ResetColorCacheStats() { color_cache_hits_ = color_cache_misses_ = 0; }
+
+  // Shows the bitplanes from "pwm_low_bit" up (at least our PWM bits), with
+  // the output-enable timing for "dither_bits" of time dithering.
+  void DumpToMatrix(GPIO *io, int pwm_low_bit, int dither_bits);
+
+  // Precompute the GPIO writes of DumpToMatrix() for the current content,
+  // so that showing it is a walk through them. Any change of the content or
+  // the PWM bits goes back to the normal output. False without InitGPIO().
+  bool Compile();
 
   void Serialize(const char **data, size_t *len) const;
   bool Deserialize(const char *data, size_t len);
   void CopyFrom(const Framebuffer *other);
 
+  // The framebuffer keeps track of the bitplanes of each double-row that
+  // were written since the last MarkClean().
+  void MarkClean();
+  // Bytes of the internal representation written since then.
+  size_t DirtySize() const;
+  // Copy only what "other" wrote since its last MarkClean(). This marks
+  // the same parts dirty here.
+  void CopyDirtyFrom(const Framebuffer *other);
+
   // Canvas-inspired methods, but we're not implementing this interface to not
   // have an unnecessary vtable.
   int width() const;
   int height() const;
   void SetPixel(int x, int y, uint8_t red, uint8_t green, uint8_t blue);
+  // Set a "width" x "height" block at "x","y" from rows of 3-byte RGB (or
+  // BGR) pixels, "stride" bytes apart. Same result as SetPixel() per pixel.
+  void SetImageBulk(int x, int y, int width, int height,
+                    const uint8_t *image, size_t stride, bool is_bgr);
+  void SetPixels(const Point *points, const Color *colors, int count);
+  void FillPixels(const Point *points, int count, const Color &color);
+  void FillSpan(int x, int y, int width, const Color &color);
   void Clear();
   void Fill(uint8_t red, uint8_t green, uint8_t blue);
 
 private:
   static const struct HardwareMapping *hardware_mapping_;
   static RowAddressSetter *row_setter_;
+  static int row_address_type_;
+
+  static RowAddressSetter *CreateRowAddressSetter(int double_rows);
 
   // This returns the gpio-bit for given color (one of 'R', 'G', 'B'). This is
   // returning the right value in case "led_sequence" is _not_ "RGB"
@@ -122,10 +209,23 @@ private:
                                             gpio_bits_t default_g,
                                             gpio_bits_t default_b);
 
-  void InitDefaultDesignator(int x, int y, const char *led_sequence,
-                             PixelDesignator *designator);
+  PixelColorBits DefaultColorBits(int y, const char *led_sequence);
+  // Write the mapped color of the pixel "pos", or the words of ColorPlanes()
+  // for it, into the bitplanes from "min_bit_plane" up.
+  inline void WritePixel(int pos, const PixelColorBits &bits,
+                         int min_bit_plane,
+                         uint16_t red, uint16_t green, uint16_t blue);
+  inline void WritePlanes(int pos, const PixelColorBits &bits,
+                          const gpio_bits_t *planes, int min_bit_plane);
   inline void  MapColors(uint8_t r, uint8_t g, uint8_t b,
                          uint16_t *red, uint16_t *green, uint16_t *blue);
+  // The words to write into each bitplane for the given color and the color
+  // "bits", from the color cache.
+  inline const gpio_bits_t *ColorPlanes(uint8_t r, uint8_t g, uint8_t b,
+                                        const PixelColorBits &bits);
+  void MapColorRow(const uint8_t *pixels, int count, bool is_bgr,
+                   uint32_t *red, uint32_t *green, uint32_t *blue);
+  void UpdateColorMap();
   const int rows_;     // Number of rows. 16 or 32.
   const int parallel_; // Parallel rows of chains. 1 or 2.
   const int height_;   // rows * parallel
@@ -137,18 +237,60 @@ private:
   uint8_t pwm_bits_;   // PWM bits to display.
   bool do_luminance_correct_;
   uint8_t brightness_;
+  ColorCorrection correction_;
+  // Bitplane bits of each value of red, green and blue with the settings
+  // above, inverted for inverse_color_; see UpdateColorMap().
+  uint16_t color_map_[3][256];
 
   const int double_rows_;
+  const bool packed_;
+  const int plane_stride_;  // Words or bytes per bitplane of a double-row.
   const size_t buffer_size_;
 
+  // DumpToMatrix() for our number of parallel chains and layout, chosen in
+  // the constructor, so that these are constants in the column loop.
+  typedef void (Framebuffer::*DumpFunction)(GPIO *io, int start_bit,
+                                            int timings);
+  template <int kParallel, bool kPacked>
+  void DumpPlanes(GPIO *io, int start_bit, int timings);
+  static DumpFunction SelectDump(int parallel, bool packed);
+  const DumpFunction dump_;
+
   // The frame-buffer is organized in bitplanes.
   // Highest level (slowest to cycle through) are double rows.
   // For each double-row, we store pwm-bits columns of a bitplane.
   // Each bitplane-column is pre-filled IoBits, of which the colors are set.
   // Of course, that means that we store unrelated bits in the frame-buffer,
   // but it allows easy access in the critical section.
-  gpio_bits_t *bitplane_buffer_;
+  // Packed, a bitplane holds the columns of each parallel chain one after
+  // the other, a byte each: red, green and blue of the upper half of the
+  // panel in bits 0..2, of the lower half in bits 3..5.
+  gpio_bits_t *bitplane_buffer_;  // NULL if packed_.
+  uint8_t *packed_buffer_;        // NULL unless packed_.
   inline gpio_bits_t *ValueAt(int double_row, int column, int bit);
+  inline char *Storage() const;
+  gpio_bits_t ColorClockMask() const;
+
+  // GPIO bits of each possible byte of a parallel chain in the packed layout.
+  static gpio_bits_t packed_expansion_[3][256];
+
+  // Bitplanes written per double-row, bit "n" for bitplane "n".
+  uint16_t *dirty_planes_;
+  inline void MarkDirty(int gpio_word, uint16_t planes);
+  void MarkAllDirty();
+
+  // The writes of DumpToMatrix() as of the last Compile(), used while
+  // "compiled_current_"; see DumpCompiled().
+  struct CompiledOutput;
+  CompiledOutput *compiled_;  // NULL before the first Compile().
+  std::atomic<bool> compiled_current_;
+  void DumpCompiled(GPIO *io, int start_bit, int timings);
+
+  // Bitplane words of recently used colors, see ColorPlanes(). NULL if off.
+  struct ColorPattern;
+  ColorPattern *color_cache_;
+  uint64_t color_cache_hits_;
+  uint64_t color_cache_misses_;
 
   PixelDesignatorMap **shared_mapper_;  // Storage in RGBMatrix.
 };
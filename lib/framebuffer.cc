@@ -28,13 +28,42 @@
 #include <string.h>
 
 #include <algorithm>
+#include <vector>
 
 #include "gpio.h"
 
 namespace rgb_matrix {
 namespace internal {
 enum {
-  kBitPlanes = 11  // maximum usable bitplanes.
+  kColorCacheSize = 1024  // entries of the color cache; a power of two.
+};
+
+// The bitplane words of one color, for pixels with the given color bits.
+// These are the same for all pixels in the same half of a panel and the same
+// parallel chain, so there are only a few combinations per color.
+// A zero-initialized entry matches nothing, as pixels always have color bits.
+struct Framebuffer::ColorPattern {
+  uint32_t color;  // r, g, b, brightness and luminance correction.
+  gpio_bits_t r_bit;
+  gpio_bits_t g_bit;
+  gpio_bits_t b_bit;
+  gpio_bits_t planes[kBitPlanes];
+};
+
+// Compiled, the words of the columns only depend on the content, and the
+// row address writes on the row and its predecessor in the scan order, as
+// all row address setters only skip writes if the row did not change.
+struct Framebuffer::CompiledOutput {
+  gpio_bits_t color_clk_mask;
+  int first_plane;     // Lowest bitplane compiled; the PWM bits at the time.
+  // The words of all columns of each double-row and bitplane from
+  // "first_plane" up, in the order they are shown.
+  std::vector<gpio_bits_t> columns;
+  // The row address and strobe writes before showing each double-row, in
+  // scan order: for its first bitplane at [2*n], for the others at [2*n+1].
+  // "writes" from row_writes[i] to row_writes[i+1].
+  std::vector<SimulatedGPIO::Write> writes;
+  std::vector<size_t> row_writes;
 };
 
 // We need one global instance of a timing correct pulser. There are different
@@ -54,9 +83,36 @@ PixelDesignator *PixelDesignatorMap::get(int x, int y) {
 }
 
 PixelDesignatorMap::PixelDesignatorMap(int width, int height,
-                                       const PixelDesignator &fill_bits)
+                                       const PixelColorBits &fill_bits)
   : width_(width), height_(height), fill_bits_(fill_bits),
-    buffer_(new PixelDesignator[width * height]) {
+    color_bits_count_(1), buffer_(new PixelDesignator[width * height]()) {
+}
+
+PixelDesignatorMap::PixelDesignatorMap(int width, int height,
+                                       const PixelDesignatorMap &other)
+  : width_(width), height_(height), fill_bits_(other.fill_bits_),
+    color_bits_count_(other.color_bits_count_),
+    buffer_(new PixelDesignator[width * height]()) {
+  std::copy(other.color_bits_, other.color_bits_ + kMaxColorBits, color_bits_);
+}
+
+PixelDesignator PixelDesignatorMap::Designate(int gpio_word,
+                                              const PixelColorBits &bits) {
+  int index = 1;
+  while (index < color_bits_count_
+         && (color_bits_[index].r_bit != bits.r_bit
+             || color_bits_[index].g_bit != bits.g_bit
+             || color_bits_[index].b_bit != bits.b_bit
+             || color_bits_[index].mask != bits.mask)) {
+    ++index;
+  }
+  if (index == color_bits_count_) {
+    // Two halves of up to three parallel chains: there are at most six.
+    assert(color_bits_count_ < kMaxColorBits);
+    color_bits_[color_bits_count_++] = bits;
+  }
+  assert(gpio_word >= 0 && gpio_word < (1 << (32 - kColorBitsIndexBits)));
+  return (PixelDesignator(gpio_word) << kColorBitsIndexBits) | index;
 }
 
 PixelDesignatorMap::~PixelDesignatorMap() {
@@ -286,11 +342,13 @@ private:
 
 const struct HardwareMapping *Framebuffer::hardware_mapping_ = NULL;
 RowAddressSetter *Framebuffer::row_setter_ = NULL;
+int Framebuffer::row_address_type_ = 0;
+gpio_bits_t Framebuffer::packed_expansion_[3][256];
 
 Framebuffer::Framebuffer(int rows, int columns, int parallel,
                          int scan_mode,
                          const char *led_sequence, bool inverse_color,
-                         PixelDesignatorMap **mapper)
+                         bool packed, PixelDesignatorMap **mapper)
   : rows_(rows),
     parallel_(parallel),
     height_(rows * parallel),
@@ -299,7 +357,13 @@ Framebuffer::Framebuffer(int rows, int columns, int parallel,
     inverse_color_(inverse_color),
     pwm_bits_(kBitPlanes), do_luminance_correct_(true), brightness_(100),
     double_rows_(rows / SUB_PANELS_),
-    buffer_size_(double_rows_ * columns_ * kBitPlanes * sizeof(gpio_bits_t)),
+    packed_(packed),
+    plane_stride_(packed ? columns * parallel : columns),
+    buffer_size_(double_rows_ * kBitPlanes * plane_stride_
+                 * (packed ? 1 : sizeof(gpio_bits_t))),
+    dump_(SelectDump(parallel, packed)),
+    compiled_(NULL), compiled_current_(false),
+    color_cache_(NULL), color_cache_hits_(0), color_cache_misses_(0),
     shared_mapper_(mapper) {
   assert(hardware_mapping_ != NULL);   // Called InitHardwareMapping() ?
   assert(shared_mapper_ != NULL);  // Storage should be provided by RGBMatrix.
@@ -313,7 +377,15 @@ Framebuffer::Framebuffer(int rows, int columns, int parallel,
   }
   assert(parallel >= 1 && parallel <= 3);
 
-  bitplane_buffer_ = new gpio_bits_t[double_rows_ * columns_ * kBitPlanes];
+  bitplane_buffer_ = NULL;
+  packed_buffer_ = NULL;
+  if (packed_) {
+    packed_buffer_ = new uint8_t[double_rows_ * kBitPlanes * plane_stride_];
+  } else {
+    bitplane_buffer_ =
+      new gpio_bits_t[double_rows_ * kBitPlanes * plane_stride_];
+  }
+  dirty_planes_ = new uint16_t[double_rows_];
 
   // If we're the first Framebuffer created, the shared PixelMapper is
   // still NULL, so create one.
@@ -330,24 +402,40 @@ Framebuffer::Framebuffer(int rows, int columns, int parallel,
     gpio_bits_t r = h.p0_r1 | h.p0_r2 | h.p1_r1 | h.p1_r2 | h.p2_r1 | h.p2_r2;
     gpio_bits_t g = h.p0_g1 | h.p0_g2 | h.p1_g1 | h.p1_g2 | h.p2_g1 | h.p2_g2;
     gpio_bits_t b = h.p0_b1 | h.p0_b2 | h.p1_b1 | h.p1_b2 | h.p2_b1 | h.p2_b2;
-    PixelDesignator fill_bits;
+    if (packed_) {
+      r = 1 | 8;
+      g = 2 | 16;
+      b = 4 | 32;
+    }
+    PixelColorBits fill_bits;
     fill_bits.r_bit = GetGpioFromLedSequence('R', led_sequence, r, g, b);
     fill_bits.g_bit = GetGpioFromLedSequence('G', led_sequence, r, g, b);
     fill_bits.b_bit = GetGpioFromLedSequence('B', led_sequence, r, g, b);
 
-    *shared_mapper_ = new PixelDesignatorMap(columns_, height_, fill_bits);
+    PixelDesignatorMap *map = new PixelDesignatorMap(columns_, height_,
+                                                     fill_bits);
     for (int y = 0; y < height_; ++y) {
+      const PixelColorBits bits = DefaultColorBits(y, led_sequence);
+      // Packed, each parallel chain has its own bytes.
+      const int row_start = (y % double_rows_) * kBitPlanes * plane_stride_
+        + (packed_ ? y / rows_ * columns_ : 0);
       for (int x = 0; x < columns_; ++x) {
-        InitDefaultDesignator(x, y, led_sequence, (*shared_mapper_)->get(x, y));
+        *map->get(x, y) = map->Designate(row_start + x, bits);
       }
     }
+    *shared_mapper_ = map;
   }
 
+  UpdateColorMap();
   Clear();
 }
 
 Framebuffer::~Framebuffer() {
+  delete compiled_;
+  delete [] color_cache_;
+  delete [] dirty_planes_;
   delete [] bitplane_buffer_;
+  delete [] packed_buffer_;
 }
 
 // TODO: this should also be parsed from some special formatted string, e.g.
@@ -387,12 +475,50 @@ Framebuffer::~Framebuffer() {
       ++mapping->max_parallel_chains;
   }
   hardware_mapping_ = mapping;
+
+  // Bits 0..5 of a packed byte are r1, g1, b1, r2, g2, b2 of its chain.
+  const gpio_bits_t chain_bits[3][6] = {
+    { mapping->p0_r1, mapping->p0_g1, mapping->p0_b1,
+      mapping->p0_r2, mapping->p0_g2, mapping->p0_b2 },
+    { mapping->p1_r1, mapping->p1_g1, mapping->p1_b1,
+      mapping->p1_r2, mapping->p1_g2, mapping->p1_b2 },
+    { mapping->p2_r1, mapping->p2_g1, mapping->p2_b1,
+      mapping->p2_r2, mapping->p2_g2, mapping->p2_b2 },
+  };
+  for (int chain = 0; chain < 3; ++chain) {
+    for (int value = 0; value < 256; ++value) {
+      gpio_bits_t bits = 0;
+      for (int bit = 0; bit < 6; ++bit) {
+        if (value & (1 << bit)) bits |= chain_bits[chain][bit];
+      }
+      packed_expansion_[chain][value] = bits;
+    }
+  }
+}
+
+/* static */ RowAddressSetter *Framebuffer::CreateRowAddressSetter(
+  int double_rows) {
+  const struct HardwareMapping &h = *hardware_mapping_;
+  switch (row_address_type_) {
+  case 0:
+    return new DirectRowAddressSetter(double_rows, h);
+  case 1:
+    return new ShiftRegisterRowAddressSetter(double_rows, h);
+  case 2:
+    return new DirectABCDLineRowAddressSetter(double_rows, h);
+  case 3:
+    return new ABCShiftRegisterRowAddressSetter(double_rows, h);
+  case 4:
+    return new SM5266RowAddressSetter(double_rows, h);
+  default:
+    assert(0);  // unexpected type.
+    return NULL;
+  }
 }
 
 /* static */ void Framebuffer::InitGPIO(GPIO *io, int rows, int parallel,
                                         bool allow_hardware_pulsing,
                                         int pwm_lsb_nanoseconds,
-                                        int dither_bits,
                                         int row_address_type) {
   if (sOutputEnablePulser != NULL)
     return;  // already initialized.
@@ -411,27 +537,8 @@ Framebuffer::~Framebuffer() {
     all_used_bits |= h.p2_r1 | h.p2_g1 | h.p2_b1 | h.p2_r2 | h.p2_g2 | h.p2_b2;
   }
 
-  const int double_rows = rows / SUB_PANELS_;
-  switch (row_address_type) {
-  case 0:
-    row_setter_ = new DirectRowAddressSetter(double_rows, h);
-    break;
-  case 1:
-    row_setter_ = new ShiftRegisterRowAddressSetter(double_rows, h);
-    break;
-  case 2:
-    row_setter_ = new DirectABCDLineRowAddressSetter(double_rows, h);
-    break;
-  case 3:
-    row_setter_ = new ABCShiftRegisterRowAddressSetter(double_rows, h);
-    break;
-  case 4:
-    row_setter_ = new SM5266RowAddressSetter(double_rows, h);
-    break;
-  default:
-    assert(0);  // unexpected type.
-  }
-
+  row_address_type_ = row_address_type;
+  row_setter_ = CreateRowAddressSetter(rows / SUB_PANELS_);
   all_used_bits |= row_setter_->need_bits();
 
   // Adafruit HAT identified by the same prefix.
@@ -441,11 +548,15 @@ Framebuffer::~Framebuffer() {
   const uint32_t result = io->InitOutputs(all_used_bits, is_some_adafruit_hat);
   assert(result == all_used_bits);  // Impl: all bits declared in gpio.cc ?
 
+  // One set of bitplane timings for each number of dither bits, so that
+  // the refresh thread can change dithering from frame to frame.
   std::vector<int> bitplane_timings;
-  uint32_t timing_ns = pwm_lsb_nanoseconds;
-  for (int b = 0; b < kBitPlanes; ++b) {
-    bitplane_timings.push_back(timing_ns);
-    if (b >= dither_bits) timing_ns *= 2;
+  for (int dither_bits = 0; dither_bits <= kMaxDitherBits; ++dither_bits) {
+    uint32_t timing_ns = pwm_lsb_nanoseconds;
+    for (int b = 0; b < kBitPlanes; ++b) {
+      bitplane_timings.push_back(timing_ns);
+      if (b >= dither_bits) timing_ns *= 2;
+    }
   }
   sOutputEnablePulser = PinPulser::Create(io, h.output_enable,
                                           allow_hardware_pulsing,
@@ -551,6 +662,7 @@ bool Framebuffer::SetPWMBits(uint8_t value) {
   if (value < 1 || value > kBitPlanes)
     return false;
   pwm_bits_ = value;
+  compiled_current_.store(false, std::memory_order_relaxed);
   return true;
 }
 
@@ -560,42 +672,89 @@ inline gpio_bits_t *Framebuffer::ValueAt(int double_row, int column, int bit) {
                             + column ];
 }
 
+inline char *Framebuffer::Storage() const {
+  return packed_ ? reinterpret_cast<char*>(packed_buffer_)
+    : reinterpret_cast<char*>(bitplane_buffer_);
+}
+
+void Framebuffer::set_color_cache(bool on) {
+  if (on == color_cache()) return;
+  if (on) {
+    color_cache_ = new ColorPattern[kColorCacheSize]();
+  } else {
+    delete [] color_cache_;
+    color_cache_ = NULL;
+  }
+}
+
+// Bitplanes from "min_bit_plane" up, as used by MarkDirty().
+static inline uint16_t PlanesFrom(int min_bit_plane) {
+  return ((1 << kBitPlanes) - 1) & ~((1 << min_bit_plane) - 1);
+}
+
+inline void Framebuffer::MarkDirty(int gpio_word, uint16_t planes) {
+  dirty_planes_[gpio_word / (plane_stride_ * kBitPlanes)] |= planes;
+  compiled_current_.store(false, std::memory_order_relaxed);
+}
+
+void Framebuffer::MarkAllDirty() {
+  compiled_current_.store(false, std::memory_order_relaxed);
+  std::fill(dirty_planes_, dirty_planes_ + double_rows_,
+            PlanesFrom(0));
+}
+
+void Framebuffer::MarkClean() {
+  std::fill(dirty_planes_, dirty_planes_ + double_rows_, 0);
+}
+
+size_t Framebuffer::DirtySize() const {
+  size_t planes = 0;
+  for (int row = 0; row < double_rows_; ++row)
+    planes += __builtin_popcount(dirty_planes_[row]);
+  return planes * (buffer_size_ / (double_rows_ * kBitPlanes));
+}
+
 void Framebuffer::Clear() {
+  MarkAllDirty();
   if (inverse_color_) {
     Fill(0, 0, 0);
   } else  {
     // Cheaper.
-    memset(bitplane_buffer_, 0,
-           sizeof(*bitplane_buffer_) * double_rows_ * columns_ * kBitPlanes);
+    memset(Storage(), 0, buffer_size_);
   }
 }
 
 // Do CIE1931 luminance correction and scale to output bitplanes
-static uint16_t luminance_cie1931(uint8_t c, uint8_t brightness) {
-  float out_factor = ((1 << kBitPlanes) - 1);
-  float v = (float) c * brightness / 255.0;
-  return out_factor * ((v <= 8) ? v / 902.3 : pow((v + 16) / 116.0, 3));
+static constexpr uint16_t luminance_cie1931(uint8_t c, float brightness) {
+  const float out_factor = ((1 << kBitPlanes) - 1);
+  const float v = (float) c * brightness / 255.0;
+  const double l = (v + 16) / 116.0;
+  return out_factor * ((v <= 8) ? v / 902.3 : l * l * l);
 }
 
-struct ColorLookup {
-  uint16_t color[256];
+struct LuminanceTable {
+  uint16_t for_brightness[100][256];
 };
-static ColorLookup *CreateLuminanceCIE1931LookupTable() {
-  ColorLookup *for_brightness = new ColorLookup[100];
-  for (int c = 0; c < 256; ++c)
-    for (int b = 0; b < 100; ++b)
-      for_brightness[b].color[c] = luminance_cie1931(c, b + 1);
-
-  return for_brightness;
+static constexpr LuminanceTable CreateLuminanceCIE1931LookupTable() {
+  LuminanceTable table = {};
+  for (int b = 0; b < 100; ++b)
+    for (int c = 0; c < 256; ++c)
+      table.for_brightness[b][c] = luminance_cie1931(c, b + 1);
+  return table;
 }
 
-static inline uint16_t CIEMapColor(uint8_t brightness, uint8_t c) {
-  static ColorLookup *luminance_lookup = CreateLuminanceCIE1931LookupTable();
-  return luminance_lookup[brightness - 1].color[c];
+// Computed by the compiler.
+static constexpr LuminanceTable kLuminanceCIE1931 =
+  CreateLuminanceCIE1931LookupTable();
+
+// Gamma curve, with the brightness scaling the input like for CIE1931.
+static uint16_t GammaMapColor(uint8_t c, float brightness, float gamma) {
+  const float out_factor = ((1 << kBitPlanes) - 1);
+  return out_factor * powf(c * brightness / (255 * 100.0f), gamma);
 }
 
 // Non luminance correction. TODO: consider getting rid of this.
-static inline uint16_t DirectMapColor(uint8_t brightness, uint8_t c) {
+static inline uint16_t DirectMapColor(float brightness, uint8_t c) {
   // simple scale down the color value
   c = c * brightness / 100;
 
@@ -603,31 +762,115 @@ static inline uint16_t DirectMapColor(uint8_t brightness, uint8_t c) {
   return (shift > 0) ? (c << shift) : (c >> -shift);
 }
 
-inline void Framebuffer::MapColors(
-  uint8_t r, uint8_t g, uint8_t b,
-  uint16_t *red, uint16_t *green, uint16_t *blue) {
+ColorCorrection::ColorCorrection() {
+  for (int i = 0; i < 3; ++i) {
+    white_balance[i] = 100;
+    gamma[i] = 0;
+  }
+}
 
-  if (do_luminance_correct_) {
-    *red   = CIEMapColor(brightness_, r);
-    *green = CIEMapColor(brightness_, g);
-    *blue  = CIEMapColor(brightness_, b);
-  } else {
-    *red   = DirectMapColor(brightness_, r);
-    *green = DirectMapColor(brightness_, g);
-    *blue  = DirectMapColor(brightness_, b);
+// One number for all three colors or three separated by commas into
+// "values". Returns false on a parse error.
+static bool ParseColorValues(const char *spec, float values[3]) {
+  float parsed[3];
+  int count = 0;
+  const char *p = spec;
+  while (count < 3) {
+    char *end;
+    parsed[count++] = strtof(p, &end);
+    if (end == p) return false;
+    p = end;
+    if (*p != ',') break;
+    ++p;
   }
+  if (*p != '\0' || count == 2) return false;
+  for (int i = 0; i < 3; ++i)
+    values[i] = parsed[count == 1 ? 0 : i];
+  return true;
+}
 
-  if (inverse_color_) {
-    *red = ~(*red);
-    *green = ~(*green);
-    *blue = ~(*blue);
+bool ColorCorrection::Parse(const char *white_balance_spec,
+                            const char *gamma_spec, std::string *err) {
+  bool success = true;
+  if (white_balance_spec && *white_balance_spec) {
+    if (!ParseColorValues(white_balance_spec, white_balance)
+        || *std::min_element(white_balance, white_balance + 3) <= 0
+        || *std::max_element(white_balance, white_balance + 3) > 100) {
+      err->append("White balance needs to be <red>,<green>,<blue> in "
+                  "percent (0..100].\n");
+      success = false;
+    }
   }
+  if (gamma_spec && *gamma_spec) {
+    if (!ParseColorValues(gamma_spec, gamma)
+        || *std::min_element(gamma, gamma + 3) < 0.1
+        || *std::max_element(gamma, gamma + 3) > 10) {
+      err->append("Gamma needs to be one number or <red>,<green>,<blue> in "
+                  "the range 0.1..10.\n");
+      success = false;
+    }
+  }
+  return success;
+}
+
+void Framebuffer::set_luminance_correct(bool on) {
+  do_luminance_correct_ = on;
+  UpdateColorMap();
+}
+
+void Framebuffer::SetBrightness(uint8_t b) {
+  brightness_ = (b <= 100 ? (b != 0 ? b : 1) : 100);
+  UpdateColorMap();
+}
+
+void Framebuffer::SetColorCorrection(const ColorCorrection &correction) {
+  correction_ = correction;
+  UpdateColorMap();
+  // The color cache only tells brightness and luminance correction apart.
+  if (color_cache_)
+    std::fill(color_cache_, color_cache_ + kColorCacheSize, ColorPattern());
+}
+
+// Everything that goes into mapping a color, once per setting instead of
+// once per pixel.
+void Framebuffer::UpdateColorMap() {
+  const uint16_t invert = inverse_color_ ? 0xffff : 0;
+  for (int channel = 0; channel < 3; ++channel) {
+    const float balance = correction_.white_balance[channel];
+    const float brightness = brightness_ * balance / 100;
+    const float gamma = correction_.gamma[channel];
+    uint16_t *const map = color_map_[channel];
+    for (int c = 0; c < 256; ++c) {
+      uint16_t value;
+      if (!do_luminance_correct_) {
+        value = DirectMapColor(brightness, c);
+      } else if (gamma > 0) {
+        value = GammaMapColor(c, brightness, gamma);
+      } else if (balance == 100) {
+        value = kLuminanceCIE1931.for_brightness[brightness_ - 1][c];
+      } else {
+        value = luminance_cie1931(c, brightness);
+      }
+      map[c] = value ^ invert;
+    }
+  }
+}
+
+inline void Framebuffer::MapColors(
+  uint8_t r, uint8_t g, uint8_t b,
+  uint16_t *red, uint16_t *green, uint16_t *blue) {
+  *red   = color_map_[0][r];
+  *green = color_map_[1][g];
+  *blue  = color_map_[2][b];
 }
 
 void Framebuffer::Fill(uint8_t r, uint8_t g, uint8_t b) {
   uint16_t red, green, blue;
   MapColors(r, g, b, &red, &green, &blue);
-  const PixelDesignator &fill = (*shared_mapper_)->GetFillColorBits();
+  const PixelColorBits &fill = (*shared_mapper_)->GetFillColorBits();
+  for (int row = 0; row < double_rows_; ++row)
+    dirty_planes_[row] |= PlanesFrom(kBitPlanes - pwm_bits_);
+  compiled_current_.store(false, std::memory_order_relaxed);
 
   for (int b = kBitPlanes - pwm_bits_; b < kBitPlanes; ++b) {
     uint16_t mask = 1 << b;
@@ -637,6 +880,11 @@ void Framebuffer::Fill(uint8_t r, uint8_t g, uint8_t b) {
     plane_bits |= ((blue & mask) == mask)  ? fill.b_bit : 0;
 
     for (int row = 0; row < double_rows_; ++row) {
+      if (packed_) {
+        memset(packed_buffer_ + (row * kBitPlanes + b) * plane_stride_,
+               plane_bits, plane_stride_);
+        continue;
+      }
       uint32_t *row_data = ValueAt(row, 0, b);
       for (int col = 0; col < columns_; ++col) {
         *row_data++ = plane_bits;
@@ -648,29 +896,310 @@ void Framebuffer::Fill(uint8_t r, uint8_t g, uint8_t b) {
 int Framebuffer::width() const { return (*shared_mapper_)->width(); }
 int Framebuffer::height() const { return (*shared_mapper_)->height(); }
 
+// Write the mapped color of one pixel into the bitplanes at "bits", which
+// points to the pixel's word (or packed byte) in the lowest plane shown.
+template <typename T>
+static inline void WritePixelBits(const PixelColorBits &color_bits,
+                                  int min_bit_plane, int columns,
+                                  uint16_t red, uint16_t green, uint16_t blue,
+                                  T *bits) {
+  const uint32_t r_bits = color_bits.r_bit;
+  const uint32_t g_bits = color_bits.g_bit;
+  const uint32_t b_bits = color_bits.b_bit;
+  const uint32_t designator_mask = color_bits.mask;
+  for (uint16_t mask = 1<<min_bit_plane; mask != 1<<kBitPlanes; mask <<=1 ) {
+    uint32_t color_bits = 0;
+    if (red & mask)   color_bits |= r_bits;
+    if (green & mask) color_bits |= g_bits;
+    if (blue & mask)  color_bits |= b_bits;
+    *bits = T((*bits & designator_mask) | color_bits);
+    bits += columns;
+  }
+}
+
+inline const gpio_bits_t *Framebuffer::ColorPlanes(
+  uint8_t r, uint8_t g, uint8_t b, const PixelColorBits &bits) {
+  const uint32_t color = r | (g << 8) | (b << 16) | (brightness_ << 24)
+    | (do_luminance_correct_ ? 1u << 31 : 0);
+  const uint32_t hash = (color ^ bits.r_bit) * 2654435761u;
+  ColorPattern *entry = &color_cache_[hash >> 22 & (kColorCacheSize - 1)];
+  if (entry->color == color && entry->r_bit == bits.r_bit
+      && entry->g_bit == bits.g_bit && entry->b_bit == bits.b_bit) {
+    ++color_cache_hits_;
+    return entry->planes;
+  }
+  ++color_cache_misses_;
+  uint16_t red, green, blue;
+  MapColors(r, g, b, &red, &green, &blue);
+  entry->color = color;
+  entry->r_bit = bits.r_bit;
+  entry->g_bit = bits.g_bit;
+  entry->b_bit = bits.b_bit;
+  for (int plane = 0; plane < kBitPlanes; ++plane) {
+    entry->planes[plane] = (((red >> plane) & 1) * bits.r_bit)
+      | (((green >> plane) & 1) * bits.g_bit)
+      | (((blue >> plane) & 1) * bits.b_bit);
+  }
+  return entry->planes;
+}
+
+// Write the words "planes" of ColorPlanes() into the bitplanes at "bits",
+// which points to the pixel's word (or packed byte) in the lowest plane shown.
+template <typename T>
+static inline void WritePlaneWords(const PixelColorBits &color_bits,
+                                   const gpio_bits_t *planes,
+                                   int min_bit_plane, int columns,
+                                   T *bits) {
+  const uint32_t designator_mask = color_bits.mask;
+  for (int plane = min_bit_plane; plane < kBitPlanes; ++plane) {
+    *bits = T((*bits & designator_mask) | planes[plane]);
+    bits += columns;
+  }
+}
+
+inline void Framebuffer::WritePixel(int pos, const PixelColorBits &bits,
+                                    int min_bit_plane, uint16_t red,
+                                    uint16_t green, uint16_t blue) {
+  pos += plane_stride_ * min_bit_plane;
+  if (packed_) {
+    WritePixelBits(bits, min_bit_plane, plane_stride_, red, green, blue,
+                   packed_buffer_ + pos);
+  } else {
+    WritePixelBits(bits, min_bit_plane, plane_stride_, red, green, blue,
+                   bitplane_buffer_ + pos);
+  }
+}
+
+inline void Framebuffer::WritePlanes(int pos, const PixelColorBits &bits,
+                                     const gpio_bits_t *planes,
+                                     int min_bit_plane) {
+  pos += plane_stride_ * min_bit_plane;
+  if (packed_) {
+    WritePlaneWords(bits, planes, min_bit_plane, plane_stride_,
+                    packed_buffer_ + pos);
+  } else {
+    WritePlaneWords(bits, planes, min_bit_plane, plane_stride_,
+                    bitplane_buffer_ + pos);
+  }
+}
+
+// Number of designators from "d" on, up to "count", that are in consecutive
+// bitplane words with the same color bits. These can be written with one
+// loop per bitplane.
+static inline int DesignatorRun(const PixelDesignator *d, int count) {
+  // Same color bits index, gpio word one further.
+  const PixelDesignator next = 1 << PixelDesignatorMap::kColorBitsIndexBits;
+  int run = 1;
+  while (run < count && d[run] == d[run-1] + next) {
+    ++run;
+  }
+  return run;
+}
+
 void Framebuffer::SetPixel(int x, int y, uint8_t r, uint8_t g, uint8_t b) {
-  const PixelDesignator *designator = (*shared_mapper_)->get(x, y);
+  PixelDesignatorMap *const mapper = *shared_mapper_;
+  const PixelDesignator *designator = mapper->get(x, y);
   if (designator == NULL) return;
-  const int pos = designator->gpio_word;
-  if (pos < 0) return;  // non-used pixel marker.
+  if (!PixelDesignatorMap::IsUsed(*designator)) return;
+  const int pos = PixelDesignatorMap::GpioWord(*designator);
+  const PixelColorBits &color_bits = mapper->ColorBits(*designator);
+
+  const int min_bit_plane = kBitPlanes - pwm_bits_;
+  MarkDirty(pos, PlanesFrom(min_bit_plane));
+  if (color_cache_ != NULL) {
+    WritePlanes(pos, color_bits, ColorPlanes(r, g, b, color_bits),
+                min_bit_plane);
+    return;
+  }
 
   uint16_t red, green, blue;
   MapColors(r, g, b, &red, &green, &blue);
+  WritePixel(pos, color_bits, min_bit_plane, red, green, blue);
+}
 
-  uint32_t *bits = bitplane_buffer_ + pos;
+void Framebuffer::SetPixels(const Point *points, const Color *colors,
+                            int count) {
+  PixelDesignatorMap *const mapper = *shared_mapper_;
   const int min_bit_plane = kBitPlanes - pwm_bits_;
-  bits += (columns_ * min_bit_plane);
-  const uint32_t r_bits = designator->r_bit;
-  const uint32_t g_bits = designator->g_bit;
-  const uint32_t b_bits = designator->b_bit;
-  const uint32_t designator_mask = designator->mask;
-  for (uint16_t mask = 1<<min_bit_plane; mask != 1<<kBitPlanes; mask <<=1 ) {
+  const uint16_t dirty_planes = PlanesFrom(min_bit_plane);
+  // Drawings mostly use few colors; only map them when they change.
+  Color last_color;
+  uint16_t red, green, blue;
+  MapColors(last_color.r, last_color.g, last_color.b, &red, &green, &blue);
+  for (int i = 0; i < count; ++i) {
+    const PixelDesignator *designator = mapper->get(points[i].x, points[i].y);
+    if (designator == NULL || !PixelDesignatorMap::IsUsed(*designator))
+      continue;
+    const int pos = PixelDesignatorMap::GpioWord(*designator);
+    const PixelColorBits &color_bits = mapper->ColorBits(*designator);
+    MarkDirty(pos, dirty_planes);
+    const Color &c = colors[i];
+    if (color_cache_ != NULL) {
+      WritePlanes(pos, color_bits, ColorPlanes(c.r, c.g, c.b, color_bits),
+                  min_bit_plane);
+      continue;
+    }
+    if (c.r != last_color.r || c.g != last_color.g || c.b != last_color.b) {
+      MapColors(c.r, c.g, c.b, &red, &green, &blue);
+      last_color = c;
+    }
+    WritePixel(pos, color_bits, min_bit_plane, red, green, blue);
+  }
+}
+
+void Framebuffer::FillPixels(const Point *points, int count,
+                             const Color &color) {
+  PixelDesignatorMap *const mapper = *shared_mapper_;
+  const int min_bit_plane = kBitPlanes - pwm_bits_;
+  const uint16_t dirty_planes = PlanesFrom(min_bit_plane);
+  uint16_t red, green, blue;
+  MapColors(color.r, color.g, color.b, &red, &green, &blue);
+  for (int i = 0; i < count; ++i) {
+    const PixelDesignator *designator = mapper->get(points[i].x, points[i].y);
+    if (designator == NULL || !PixelDesignatorMap::IsUsed(*designator))
+      continue;
+    const int pos = PixelDesignatorMap::GpioWord(*designator);
+    MarkDirty(pos, dirty_planes);
+    WritePixel(pos, mapper->ColorBits(*designator), min_bit_plane,
+               red, green, blue);
+  }
+}
+
+// Write one mapped color into "run" consecutive words (or packed bytes) from
+// "bits" on, which points into the lowest plane shown.
+template <typename T>
+static inline void FillRun(const PixelColorBits &pixel_bits, int run,
+                           int min_bit_plane, int columns,
+                           uint16_t red, uint16_t green, uint16_t blue,
+                           T *bits) {
+  const uint32_t designator_mask = pixel_bits.mask;
+  for (uint16_t mask = 1<<min_bit_plane; mask != 1<<kBitPlanes; mask <<=1) {
     uint32_t color_bits = 0;
-    if (red & mask)   color_bits |= r_bits;
-    if (green & mask) color_bits |= g_bits;
-    if (blue & mask)  color_bits |= b_bits;
-    *bits = (*bits & designator_mask) | color_bits;
-    bits += columns_;
+    if (red & mask)   color_bits |= pixel_bits.r_bit;
+    if (green & mask) color_bits |= pixel_bits.g_bit;
+    if (blue & mask)  color_bits |= pixel_bits.b_bit;
+    for (int i = 0; i < run; ++i) {
+      bits[i] = T((bits[i] & designator_mask) | color_bits);
+    }
+    bits += columns;
+  }
+}
+
+void Framebuffer::FillSpan(int x, int y, int width, const Color &color) {
+  PixelDesignatorMap *const mapper = *shared_mapper_;
+  if (y < 0 || y >= mapper->height()) return;
+  if (x < 0) { width += x; x = 0; }
+  width = std::min(width, mapper->width() - x);
+  if (width <= 0) return;
+
+  uint16_t red, green, blue;
+  MapColors(color.r, color.g, color.b, &red, &green, &blue);
+  const int min_bit_plane = kBitPlanes - pwm_bits_;
+  const PixelDesignator *d = mapper->get(x, y);
+  const PixelDesignator *const end = d + width;
+  while (d < end) {
+    if (!PixelDesignatorMap::IsUsed(*d)) {
+      ++d;
+      continue;
+    }
+    const int run = DesignatorRun(d, end - d);
+    const int pos = PixelDesignatorMap::GpioWord(*d);
+    const PixelColorBits &pixel_bits = mapper->ColorBits(*d);
+    MarkDirty(pos, PlanesFrom(min_bit_plane));
+    const int first = pos + plane_stride_ * min_bit_plane;
+    if (packed_) {
+      FillRun(pixel_bits, run, min_bit_plane, plane_stride_, red, green, blue,
+              packed_buffer_ + first);
+    } else {
+      FillRun(pixel_bits, run, min_bit_plane, plane_stride_, red, green, blue,
+              bitplane_buffer_ + first);
+    }
+    d += run;
+  }
+}
+
+void Framebuffer::MapColorRow(const uint8_t *pixels, int count, bool is_bgr,
+                              uint32_t *red, uint32_t *green, uint32_t *blue) {
+  const int r_offset = is_bgr ? 2 : 0;
+  const int b_offset = is_bgr ? 0 : 2;
+  for (int i = 0; i < count; ++i, pixels += 3) {
+    red[i]   = color_map_[0][pixels[r_offset]];
+    green[i] = color_map_[1][pixels[1]];
+    blue[i]  = color_map_[2][pixels[b_offset]];
+  }
+}
+
+// Write "run" mapped colors into consecutive words (or packed bytes) from
+// "bits" on, which points into the lowest plane shown.
+template <typename T>
+static inline void WriteRun(const PixelColorBits &pixel_bits, int run,
+                            int min_bit_plane, int columns,
+                            const uint32_t *r, const uint32_t *g,
+                            const uint32_t *b, T *bits) {
+  const uint32_t r_bits = pixel_bits.r_bit;
+  const uint32_t g_bits = pixel_bits.g_bit;
+  const uint32_t b_bits = pixel_bits.b_bit;
+  const uint32_t designator_mask = pixel_bits.mask;
+  for (int plane = min_bit_plane; plane < kBitPlanes; ++plane) {
+    for (int i = 0; i < run; ++i) {
+      bits[i] = T((bits[i] & designator_mask)
+                  | (((r[i] >> plane) & 1) * r_bits)
+                  | (((g[i] >> plane) & 1) * g_bits)
+                  | (((b[i] >> plane) & 1) * b_bits));
+    }
+    bits += columns;
+  }
+}
+
+// Instead of walking the bitplanes for each pixel like SetPixel(), this first
+// maps the colors of a stretch of the row, then walks the bitplanes once and
+// slices out the bit of that plane for all pixels. Without a pixel mapper (and
+// with most mappers), neighboring pixels are neighboring words in a bitplane
+// with the same color bits, so the inner loop is a plain loop over
+// consecutive words that the compiler vectorizes (SSE on x86, NEON on ARM).
+void Framebuffer::SetImageBulk(int x, int y, int width, int height,
+                               const uint8_t *image, size_t stride,
+                               bool is_bgr) {
+  PixelDesignatorMap *const mapper = *shared_mapper_;
+  if (x < 0) { image -= 3 * x; width += x; x = 0; }
+  if (y < 0) { image -= stride * y; height += y; y = 0; }
+  width = std::min(width, mapper->width() - x);
+  height = std::min(height, mapper->height() - y);
+  if (width <= 0 || height <= 0) return;
+
+  enum { kChunk = 64 };
+  uint32_t red[kChunk], green[kChunk], blue[kChunk];
+  const int min_bit_plane = kBitPlanes - pwm_bits_;
+
+  for (int row = y; row < y + height; ++row, image += stride) {
+    const PixelDesignator *const designators = mapper->get(x, row);
+    for (int chunk = 0; chunk < width; chunk += kChunk) {
+      const int count = std::min<int>(kChunk, width - chunk);
+      const PixelDesignator *d = designators + chunk;
+      MapColorRow(image + 3 * chunk, count, is_bgr, red, green, blue);
+
+      int start = 0;
+      while (start < count) {
+        if (!PixelDesignatorMap::IsUsed(d[start])) {
+          ++start;
+          continue;
+        }
+        const int end = start + DesignatorRun(d + start, count - start);
+        const int pos = PixelDesignatorMap::GpioWord(d[start]);
+        const PixelColorBits &pixel_bits = mapper->ColorBits(d[start]);
+        const int run = end - start;
+        MarkDirty(pos, PlanesFrom(min_bit_plane));
+        const int first = pos + plane_stride_ * min_bit_plane;
+        if (packed_) {
+          WriteRun(pixel_bits, run, min_bit_plane, plane_stride_, red + start,
+                   green + start, blue + start, packed_buffer_ + first);
+        } else {
+          WriteRun(pixel_bits, run, min_bit_plane, plane_stride_, red + start,
+                   green + start, blue + start, bitplane_buffer_ + first);
+        }
+        start = end;
+      }
+    }
   }
 }
 
@@ -695,66 +1224,99 @@ gpio_bits_t Framebuffer::GetGpioFromLedSequence(char col,
   return default_r;  // String too long, should've been caught earlier.
 }
 
-void Framebuffer::InitDefaultDesignator(int x, int y, const char *seq,
-                                        PixelDesignator *d) {
+PixelColorBits Framebuffer::DefaultColorBits(int y, const char *seq) {
   const struct HardwareMapping &h = *hardware_mapping_;
-  uint32_t *bits = ValueAt(y % double_rows_, x, 0);
-  d->gpio_word = bits - bitplane_buffer_;
-  d->r_bit = d->g_bit = d->b_bit = 0;
+  PixelColorBits d;
+  if (packed_) {
+    // Bits in the byte of the parallel chain, see packed_buffer_.
+    const gpio_bits_t r = (y % rows_ < double_rows_) ? 1 : 8;
+    d.r_bit = GetGpioFromLedSequence('R', seq, r, r << 1, r << 2);
+    d.g_bit = GetGpioFromLedSequence('G', seq, r, r << 1, r << 2);
+    d.b_bit = GetGpioFromLedSequence('B', seq, r, r << 1, r << 2);
+    d.mask = ~(d.r_bit | d.g_bit | d.b_bit);
+    return d;
+  }
   if (y < rows_) {
     if (y < double_rows_) {
-      d->r_bit = GetGpioFromLedSequence('R', seq, h.p0_r1, h.p0_g1, h.p0_b1);
-      d->g_bit = GetGpioFromLedSequence('G', seq, h.p0_r1, h.p0_g1, h.p0_b1);
-      d->b_bit = GetGpioFromLedSequence('B', seq, h.p0_r1, h.p0_g1, h.p0_b1);
+      d.r_bit = GetGpioFromLedSequence('R', seq, h.p0_r1, h.p0_g1, h.p0_b1);
+      d.g_bit = GetGpioFromLedSequence('G', seq, h.p0_r1, h.p0_g1, h.p0_b1);
+      d.b_bit = GetGpioFromLedSequence('B', seq, h.p0_r1, h.p0_g1, h.p0_b1);
     } else {
-      d->r_bit = GetGpioFromLedSequence('R', seq, h.p0_r2, h.p0_g2, h.p0_b2);
-      d->g_bit = GetGpioFromLedSequence('G', seq, h.p0_r2, h.p0_g2, h.p0_b2);
-      d->b_bit = GetGpioFromLedSequence('B', seq, h.p0_r2, h.p0_g2, h.p0_b2);
+      d.r_bit = GetGpioFromLedSequence('R', seq, h.p0_r2, h.p0_g2, h.p0_b2);
+      d.g_bit = GetGpioFromLedSequence('G', seq, h.p0_r2, h.p0_g2, h.p0_b2);
+      d.b_bit = GetGpioFromLedSequence('B', seq, h.p0_r2, h.p0_g2, h.p0_b2);
     }
   }
   else if (y >= rows_ && y < 2 * rows_) {
     if (y - rows_ < double_rows_) {
-      d->r_bit = GetGpioFromLedSequence('R', seq, h.p1_r1, h.p1_g1, h.p1_b1);
-      d->g_bit = GetGpioFromLedSequence('G', seq, h.p1_r1, h.p1_g1, h.p1_b1);
-      d->b_bit = GetGpioFromLedSequence('B', seq, h.p1_r1, h.p1_g1, h.p1_b1);
+      d.r_bit = GetGpioFromLedSequence('R', seq, h.p1_r1, h.p1_g1, h.p1_b1);
+      d.g_bit = GetGpioFromLedSequence('G', seq, h.p1_r1, h.p1_g1, h.p1_b1);
+      d.b_bit = GetGpioFromLedSequence('B', seq, h.p1_r1, h.p1_g1, h.p1_b1);
     } else {
-      d->r_bit = GetGpioFromLedSequence('R', seq, h.p1_r2, h.p1_g2, h.p1_b2);
-      d->g_bit = GetGpioFromLedSequence('G', seq, h.p1_r2, h.p1_g2, h.p1_b2);
-      d->b_bit = GetGpioFromLedSequence('B', seq, h.p1_r2, h.p1_g2, h.p1_b2);
+      d.r_bit = GetGpioFromLedSequence('R', seq, h.p1_r2, h.p1_g2, h.p1_b2);
+      d.g_bit = GetGpioFromLedSequence('G', seq, h.p1_r2, h.p1_g2, h.p1_b2);
+      d.b_bit = GetGpioFromLedSequence('B', seq, h.p1_r2, h.p1_g2, h.p1_b2);
     }
   }
   else {
     if (y - 2*rows_ < double_rows_) {
-      d->r_bit = GetGpioFromLedSequence('R', seq, h.p2_r1, h.p2_g1, h.p2_b1);
-      d->g_bit = GetGpioFromLedSequence('G', seq, h.p2_r1, h.p2_g1, h.p2_b1);
-      d->b_bit = GetGpioFromLedSequence('B', seq, h.p2_r1, h.p2_g1, h.p2_b1);
+      d.r_bit = GetGpioFromLedSequence('R', seq, h.p2_r1, h.p2_g1, h.p2_b1);
+      d.g_bit = GetGpioFromLedSequence('G', seq, h.p2_r1, h.p2_g1, h.p2_b1);
+      d.b_bit = GetGpioFromLedSequence('B', seq, h.p2_r1, h.p2_g1, h.p2_b1);
     } else {
-      d->r_bit = GetGpioFromLedSequence('R', seq, h.p2_r2, h.p2_g2, h.p2_b2);
-      d->g_bit = GetGpioFromLedSequence('G', seq, h.p2_r2, h.p2_g2, h.p2_b2);
-      d->b_bit = GetGpioFromLedSequence('B', seq, h.p2_r2, h.p2_g2, h.p2_b2);
+      d.r_bit = GetGpioFromLedSequence('R', seq, h.p2_r2, h.p2_g2, h.p2_b2);
+      d.g_bit = GetGpioFromLedSequence('G', seq, h.p2_r2, h.p2_g2, h.p2_b2);
+      d.b_bit = GetGpioFromLedSequence('B', seq, h.p2_r2, h.p2_g2, h.p2_b2);
     }
   }
 
-  d->mask = ~(d->r_bit | d->g_bit | d->b_bit);
+  d.mask = ~(d.r_bit | d.g_bit | d.b_bit);
+  return d;
 }
 
 void Framebuffer::Serialize(const char **data, size_t *len) const {
-  *data = reinterpret_cast<const char*>(bitplane_buffer_);
+  *data = Storage();
   *len = buffer_size_;
 }
 
 bool Framebuffer::Deserialize(const char *data, size_t len) {
   if (len != buffer_size_) return false;
-  memcpy(bitplane_buffer_, data, len);
+  memcpy(Storage(), data, len);
+  MarkAllDirty();
   return true;
 }
 
 void Framebuffer::CopyFrom(const Framebuffer *other) {
   if (other == this) return;
-  memcpy(bitplane_buffer_, other->bitplane_buffer_, buffer_size_);
+  memcpy(Storage(), other->Storage(), buffer_size_);
+  MarkAllDirty();
+}
+
+void Framebuffer::CopyDirtyFrom(const Framebuffer *other) {
+  if (other == this) return;
+  compiled_current_.store(false, std::memory_order_relaxed);
+  const size_t plane_size = buffer_size_ / (double_rows_ * kBitPlanes);
+  for (int row = 0; row < double_rows_; ++row) {
+    const uint16_t dirty = other->dirty_planes_[row];
+    dirty_planes_[row] |= dirty;
+    // The bitplanes of a double-row are consecutive; copy runs of them.
+    int plane = 0;
+    while (plane < kBitPlanes) {
+      if ((dirty & (1 << plane)) == 0) {
+        ++plane;
+        continue;
+      }
+      const int first = plane;
+      while (plane < kBitPlanes && (dirty & (1 << plane)))
+        ++plane;
+      const size_t offset = (row * kBitPlanes + first) * plane_size;
+      memcpy(Storage() + offset, other->Storage() + offset,
+             (plane - first) * plane_size);
+    }
+  }
 }
 
-void Framebuffer::DumpToMatrix(GPIO *io, int pwm_low_bit) {
+gpio_bits_t Framebuffer::ColorClockMask() const {
   const struct HardwareMapping &h = *hardware_mapping_;
   gpio_bits_t color_clk_mask = 0;  // Mask of bits while clocking in.
   color_clk_mask |= h.p0_r1 | h.p0_g1 | h.p0_b1 | h.p0_r2 | h.p0_g2 | h.p0_b2;
@@ -766,35 +1328,79 @@ void Framebuffer::DumpToMatrix(GPIO *io, int pwm_low_bit) {
   }
 
   color_clk_mask |= h.clock;
+  return color_clk_mask;
+}
+
+// The double-row shown "row_loop"th in a frame.
+static inline int ScanRow(int scan_mode, int double_rows, int row_loop) {
+  switch (scan_mode) {
+  case 0:  // progressive
+  default:
+    return row_loop;
 
+  case 1:  // interlaced
+    const int half_double = double_rows/2;
+    return ((row_loop < half_double)
+            ? (row_loop << 1)
+            : ((row_loop - half_double) << 1) + 1);
+  }
+}
+
+/* static */ Framebuffer::DumpFunction Framebuffer::SelectDump(int parallel,
+                                                              bool packed) {
+  static const DumpFunction kDumps[3][2] = {
+    { &Framebuffer::DumpPlanes<1, false>, &Framebuffer::DumpPlanes<1, true> },
+    { &Framebuffer::DumpPlanes<2, false>, &Framebuffer::DumpPlanes<2, true> },
+    { &Framebuffer::DumpPlanes<3, false>, &Framebuffer::DumpPlanes<3, true> },
+  };
+  return kDumps[parallel - 1][packed];
+}
+
+void Framebuffer::DumpToMatrix(GPIO *io, int pwm_low_bit, int dither_bits) {
   // Depending if we do dithering, we might not always show the lowest bits.
   const int start_bit = std::max(pwm_low_bit, kBitPlanes - pwm_bits_);
+  const int timings = dither_bits * kBitPlanes;
 
-  const uint8_t half_double = double_rows_/2;
-  for (uint8_t row_loop = 0; row_loop < double_rows_; ++row_loop) {
-    uint8_t d_row;
-    switch (scan_mode_) {
-    case 0:  // progressive
-    default:
-      d_row = row_loop;
-      break;
+  if (compiled_current_.load(std::memory_order_acquire)) {
+    DumpCompiled(io, start_bit, timings);
+    return;
+  }
+  (this->*dump_)(io, start_bit, timings);
+}
 
-    case 1:  // interlaced
-      d_row = ((row_loop < half_double)
-               ? (row_loop << 1)
-               : ((row_loop - half_double) << 1) + 1);
-    }
+template <int kParallel, bool kPacked>
+void Framebuffer::DumpPlanes(GPIO *io, int start_bit, int timings) {
+  const struct HardwareMapping &h = *hardware_mapping_;
+  const gpio_bits_t color_clk_mask = ColorClockMask();
+  const gpio_bits_t clock = h.clock;
+  const int columns = columns_;
+
+  for (int row_loop = 0; row_loop < double_rows_; ++row_loop) {
+    const int d_row = ScanRow(scan_mode_, double_rows_, row_loop);
 
     // Rows can't be switched very quickly without ghosting, so we do the
     // full PWM of one row before switching rows.
     for (int b = start_bit; b < kBitPlanes; ++b) {
-      gpio_bits_t *row_data = ValueAt(d_row, 0, b);
       // While the output enable is still on, we can already clock in the next
       // data.
-      for (int col = 0; col < columns_; ++col) {
-        const gpio_bits_t &out = *row_data++;
-        io->WriteMaskedBits(out, color_clk_mask);  // col + reset clock
-        io->SetBits(h.clock);               // Rising edge: clock color in.
+      if (kPacked) {
+        const uint8_t *const plane_data =
+          packed_buffer_ + (d_row * kBitPlanes + b) * plane_stride_;
+        for (int col = 0; col < columns; ++col) {
+          gpio_bits_t out = packed_expansion_[0][plane_data[col]];
+          if (kParallel >= 2)
+            out |= packed_expansion_[1][plane_data[columns + col]];
+          if (kParallel >= 3)
+            out |= packed_expansion_[2][plane_data[2 * columns + col]];
+          io->WriteMaskedBits(out, color_clk_mask);  // col + reset clock
+          io->SetBits(clock);                 // Rising edge: clock color in.
+        }
+      } else {
+        const gpio_bits_t *row_data = ValueAt(d_row, 0, b);
+        for (int col = 0; col < columns; ++col) {
+          io->WriteMaskedBits(row_data[col], color_clk_mask);  // col + clock
+          io->SetBits(clock);                 // Rising edge: clock color in.
+        }
       }
       io->ClearBits(color_clk_mask);    // clock back to normal.
 
@@ -808,8 +1414,117 @@ void Framebuffer::DumpToMatrix(GPIO *io, int pwm_low_bit) {
       io->ClearBits(h.strobe);
 
       // Now switch on for the sleep time necessary for that bit-plane.
-      sOutputEnablePulser->SendPulse(b);
+      sOutputEnablePulser->SendPulse(timings + b);
+    }
+  }
+}
+
+bool Framebuffer::Compile() {
+  if (row_setter_ == NULL)
+    return false;  // InitGPIO() not called yet.
+  const struct HardwareMapping &h = *hardware_mapping_;
+  if (compiled_ == NULL)
+    compiled_ = new CompiledOutput();
+  CompiledOutput *const c = compiled_;
+  c->color_clk_mask = ColorClockMask();
+  c->first_plane = kBitPlanes - pwm_bits_;
+  c->columns.clear();
+  c->columns.reserve(double_rows_ * pwm_bits_ * columns_);
+  c->writes.clear();
+  c->row_writes.assign(1, 0);
+
+  // Get the row address writes from a row address setter of our own,
+  // writing to a SimulatedGPIO. A frame starts after the last row of the
+  // previous one.
+  SimulatedGPIO simulation;
+  GPIO capture;
+  capture.InitSimulated(&simulation);
+  RowAddressSetter *const row_setter = CreateRowAddressSetter(double_rows_);
+  const int last_row = ScanRow(scan_mode_, double_rows_, double_rows_ - 1);
+  row_setter->SetRowAddress(&capture, last_row);
+
+  for (int row_loop = 0; row_loop < double_rows_; ++row_loop) {
+    const int d_row = ScanRow(scan_mode_, double_rows_, row_loop);
+    for (int b = c->first_plane; b < kBitPlanes; ++b) {
+      const uint8_t *const plane_data = packed_
+        ? packed_buffer_ + (d_row * kBitPlanes + b) * plane_stride_
+        : NULL;
+      for (int col = 0; col < columns_; ++col) {
+        gpio_bits_t out = 0;
+        if (packed_) {
+          for (int p = 0; p < parallel_; ++p)
+            out |= packed_expansion_[p][plane_data[p * columns_ + col]];
+        } else {
+          out = *ValueAt(d_row, col, b);
+        }
+        c->columns.push_back(out & c->color_clk_mask);
+      }
+    }
+    for (int i = 0; i < 2; ++i) {
+      simulation.StartRecording(1);
+      capture.Read();  // Records from here to the next Read().
+      row_setter->SetRowAddress(&capture, d_row);
+      capture.SetBits(h.strobe);
+      capture.ClearBits(h.strobe);
+      capture.Read();
+      c->writes.insert(c->writes.end(), simulation.recording().begin(),
+                       simulation.recording().end());
+      c->row_writes.push_back(c->writes.size());
+    }
+  }
+  delete row_setter;
+
+  compiled_current_.store(true, std::memory_order_release);
+  return true;
+}
+
+// The writes of DumpToMatrix() from the compiled output: no lookups, only
+// walking through the column words and the row writes.
+void Framebuffer::DumpCompiled(GPIO *io, int start_bit, int timings) {
+  const gpio_bits_t clock = hardware_mapping_->clock;
+  const CompiledOutput &c = *compiled_;
+  const gpio_bits_t color_clk_mask = c.color_clk_mask;
+  const int planes = kBitPlanes - c.first_plane;
+  const gpio_bits_t *row_data =
+    &c.columns[0] + (start_bit - c.first_plane) * columns_;
+  const SimulatedGPIO::Write *const writes = &c.writes[0];
+  const size_t *row_writes = &c.row_writes[0];
+
+  for (int row_loop = 0; row_loop < double_rows_; ++row_loop) {
+    const gpio_bits_t *data = row_data;
+    for (int b = start_bit; b < kBitPlanes; ++b) {
+      for (const gpio_bits_t *end = data + columns_; data != end; ++data) {
+        io->WriteMaskedBits(*data, color_clk_mask);  // col + reset clock
+        io->SetBits(clock);                 // Rising edge: clock color in.
+      }
+      io->ClearBits(color_clk_mask);    // clock back to normal.
+
+      sOutputEnablePulser->WaitPulseFinished();
+
+      // Row address and strobe.
+      const int n = (b == start_bit) ? 0 : 1;
+      const SimulatedGPIO::Write *const end = writes + row_writes[n + 1];
+      for (const SimulatedGPIO::Write *w = writes + row_writes[n];
+           w != end; ++w) {
+        switch (w->op) {
+        case SimulatedGPIO::SET_BITS:
+          io->SetBits(w->value);
+          break;
+        case SimulatedGPIO::CLEAR_BITS:
+          io->ClearBits(w->value);
+          break;
+        case SimulatedGPIO::WRITE_MASKED_BITS:
+          io->WriteMaskedBits(w->value, w->mask);
+          break;
+        case SimulatedGPIO::PULSE:
+          break;  // Row address setters don't pulse.
+        }
+      }
+
+      sOutputEnablePulser->SendPulse(timings + b);
     }
+    row_data += planes * columns_;
+    row_writes += 2;
   }
 }
 }  // namespace internal
@@ -17,6 +17,7 @@
 #include <inttypes.h>
 
 #include "gpio.h"
+#include "refresh-stats.h"
 
 #include <assert.h>
 #include <fcntl.h>
@@ -34,7 +35,15 @@
  * we substract this value whenever we do nanosleep(); the remaining time
  * we then busy wait to get a good accurate result.
  *
- * You can measure the overhead using DEBUG_SLEEP_JITTER below.
+ * This and the jitter allowance derived from it are only defaults: the
+ * sleep-calibrate tool measures both on the running machine and stores them
+ * in the SleepTiming config file, which overrides them.
+ *
+ * You can measure the overhead with the overshoot histogram of the refresh
+ * statistics (--led-refresh-stats, see include/refresh-stats.h) while using the
+ * hardware pin-pulser. It shows how much longer than the allowance nanosleep()
+ * took; to get a full histogram of OS overhead, set it to 0 first. The sleep
+ * histogram there shows the same for the timer based pin-pulser.
  *
  * Note: A higher value here will result in more CPU use because of more busy
  * waiting inching towards the real value (for all the cases that nanosleep()
@@ -52,15 +61,6 @@
  */
 #define MINIMUM_NANOSLEEP_TIME_US 5
 
-/* In order to determine useful values for above, set this to 1 and use the
- * hardware pin-pulser.
- * It will output a histogram atexit() of how much how often we were over
- * the requested time.
- * (The full histogram will be shifted by the EMPIRICAL_NANOSLEEP_OVERHEAD_US
- *  value above. To get a full histogram of OS overhead, set it to 0 first).
- */
-#define DEBUG_SLEEP_JITTER 0
-
 // Raspberry 1 and 2 have different base addresses for the periphery
 #define BCM2708_PERI_BASE        0x20000000
 #define BCM2709_PERI_BASE        0x3F000000
@@ -136,12 +136,56 @@ namespace rgb_matrix {
    (1 << 19) | (1 << 20) | (1 << 21) | (1 << 26)
 );
 
+SimulatedGPIO::SimulatedGPIO()
+  : outputs_(0), inputs_(0), write_count_(0), pulse_count_(0),
+    pulse_nanos_(0), frame_count_(0), recording_(false), frames_to_record_(0),
+    recording_requested_(false), recording_done_(false) {
+}
+
+uint32_t SimulatedGPIO::Read() {
+  Increment(&frame_count_, 1);
+  if (recording_) {
+    if (--frames_to_record_ <= 0) {
+      recording_ = false;
+      recording_done_.store(true, std::memory_order_release);
+    }
+  } else if (recording_requested_.load(std::memory_order_acquire)) {
+    recording_requested_.store(false, std::memory_order_relaxed);
+    recording_ = true;   // Starting with the next frame.
+  }
+  return inputs_;
+}
+
+void SimulatedGPIO::StartRecording(int frames) {
+  recording_log_.clear();
+  frames_to_record_ = frames;
+  recording_done_.store(false, std::memory_order_relaxed);
+  recording_requested_.store(true, std::memory_order_release);
+}
+
+void SimulatedGPIO::Record(Operation op, uint32_t value, uint32_t mask) {
+  Write w;
+  w.op = op;
+  w.value = value;
+  w.mask = mask;
+  recording_log_.push_back(w);
+}
+
 GPIO::GPIO() : output_bits_(0), input_bits_(0), reserved_bits_(0),
-               slowdown_(1) {
+               slowdown_(1), simulation_(NULL) {
 }
 
 uint32_t GPIO::InitOutputs(uint32_t outputs,
                            bool adafruit_pwm_transition_hack_needed) {
+  if (simulation_) {
+    // No pin modes to set; just keep track of the bits.
+    if (adafruit_pwm_transition_hack_needed)
+      reserved_bits_ = (1<<4) & ~outputs;
+    outputs &= kValidBits;
+    outputs &= ~(output_bits_ | input_bits_ | reserved_bits_);
+    output_bits_ |= outputs;
+    return outputs;
+  }
   if (s_GPIO_registers == NULL) {
     fprintf(stderr, "Attempt to init outputs but not yet Init()-ialized.\n");
     return 0;
@@ -178,6 +222,12 @@ uint32_t GPIO::InitOutputs(uint32_t outputs,
 }
 
 uint32_t GPIO::RequestInputs(uint32_t inputs) {
+  if (simulation_) {
+    inputs &= kValidBits;
+    inputs &= ~(output_bits_ | input_bits_ | reserved_bits_);
+    input_bits_ |= inputs;
+    return inputs;
+  }
   if (s_GPIO_registers == NULL) {
     fprintf(stderr, "Attempt to init inputs but not yet Init()-ialized.\n");
     return 0;
@@ -344,6 +394,13 @@ bool GPIO::Init(int slowdown) {
   return true;
 }
 
+bool GPIO::InitSimulated(SimulatedGPIO *simulation) {
+  assert(simulation != NULL);
+  simulation_ = simulation;
+  gpio_set_bits_ = gpio_clr_bits_ = gpio_read_bits_ = NULL;
+  return true;
+}
+
 /*
  * We support also other pinouts that don't have the OE- on the hardware
  * PWM output pin, so we need to provide (impefect) 'manual' timing as well.
@@ -357,6 +414,9 @@ class Timers {
 public:
   static bool Init();
   static void sleep_nanos(long t);
+
+private:
+  static void sleep_nanos_impl(long t);
 };
 
 // Simplest of PinPulsers. Uses somewhat jittery and manual timers
@@ -385,6 +445,24 @@ private:
   const std::vector<int> nano_specs_;
 };
 
+// PinPulser for the SimulatedGPIO. Records the pulse without waiting, so that
+// measurements only show the time spent computing and writing the bits.
+class SimulatedPinPulser : public PinPulser {
+public:
+  SimulatedPinPulser(SimulatedGPIO *simulation, uint32_t bits,
+                     const std::vector<int> &nano_specs)
+    : simulation_(simulation), bits_(bits), nano_specs_(nano_specs) {}
+
+  virtual void SendPulse(int time_spec_number) {
+    simulation_->Pulse(bits_, nano_specs_[time_spec_number]);
+  }
+
+private:
+  SimulatedGPIO *const simulation_;
+  const uint32_t bits_;
+  const std::vector<int> nano_specs_;
+};
+
 static bool LinuxHasModuleLoaded(const char *name) {
   FILE *f = fopen("/proc/modules", "r");
   if (f == NULL) return false; // don't care.
@@ -407,6 +485,12 @@ static void busy_wait_nanos_rpi_3(long nanos);
 static void busy_wait_nanos_rpi_4(long nanos);
 static void (*busy_wait_impl)(long) = busy_wait_nanos_rpi_3;
 
+// The values Timers and HardwarePinPulser work with.
+static SleepTiming s_sleep_timing;
+
+// Where the pin pulsers record how long their waits took, if anywhere.
+static std::atomic<RefreshStats*> s_timing_stats(NULL);
+
 // Best effort write to file. Used to set kernel parameters.
 static void WriteTo(const char *filename, const char *str) {
   const int fd = open(filename, O_WRONLY);
@@ -428,7 +512,32 @@ static void DisableRealtimeThrottling() {
   WriteTo("/proc/sys/kernel/sched_rt_runtime_us", "999000");
 }
 
+static void LoadSleepTimingOnce() {
+  static bool loaded = false;
+  if (loaded) return;
+  loaded = true;
+
+  // If this is a Raspberry Pi with more than one core, we add a bit of
+  // additional overhead measured up to the 99.999%-ile: we can allow to burn
+  // a bit more busy-wait CPU cycles to get the timing accurate as we have
+  // more CPU to spare.
+  switch (GetPiModel()) {
+  case PI_MODEL_1:
+    break;  // 99.9%-ile
+  case PI_MODEL_2: case PI_MODEL_3:
+    s_sleep_timing.jitter_allowance_us += 35;  // 99.999%-ile
+    break;
+  case PI_MODEL_4:
+    s_sleep_timing.jitter_allowance_us += 10;  // this one is fast.
+    break;
+  }
+
+  // Measured on this machine; better than the above.
+  s_sleep_timing.Load(SleepTiming::ConfigFile());
+}
+
 bool Timers::Init() {
+  LoadSleepTimingOnce();
   if (!mmap_all_bcm_registers_once())
     return false;
 
@@ -448,22 +557,27 @@ bool Timers::Init() {
 }
 
 static uint32_t JitterAllowanceMicroseconds() {
-  // If this is a Raspberry Pi with more than one core, we add a bit of
-  // additional overhead measured up to the 99.999%-ile: we can allow to burn
-  // a bit more busy-wait CPU cycles to get the timing accurate as we have
-  // more CPU to spare.
-  switch (GetPiModel()) {
-  case PI_MODEL_1:
-    return EMPIRICAL_NANOSLEEP_OVERHEAD_US;  // 99.9%-ile
-  case PI_MODEL_2: case PI_MODEL_3:
-    return EMPIRICAL_NANOSLEEP_OVERHEAD_US + 35;  // 99.999%-ile
-  case PI_MODEL_4:
-    return EMPIRICAL_NANOSLEEP_OVERHEAD_US + 10;  // this one is fast.
-  }
-  return EMPIRICAL_NANOSLEEP_OVERHEAD_US;
+  return s_sleep_timing.jitter_allowance_us;
 }
 
 void Timers::sleep_nanos(long nanos) {
+  RefreshStats *const stats = s_timing_stats.load(std::memory_order_acquire);
+  if (stats == NULL) {
+    sleep_nanos_impl(nanos);
+    return;
+  }
+  const uint32_t start_us = GetMicrosecondCounter();
+  sleep_nanos_impl(nanos);
+  const int error_us = int(GetMicrosecondCounter() - start_us) - nanos / 1000;
+  // Only the refresh thread writes, so no need for a locked increment.
+  std::atomic<uint32_t> &count =
+    stats->sleep_histogram[RefreshStats::SleepRequestBucket(nanos)]
+                          [RefreshStats::SleepErrorBucket(error_us)];
+  count.store(count.load(std::memory_order_relaxed) + 1,
+              std::memory_order_relaxed);
+}
+
+void Timers::sleep_nanos_impl(long nanos) {
   // For smaller durations, we go straight to busy wait.
 
   // For larger duration, we use nanosleep() to give the operating system
@@ -491,9 +605,9 @@ void Timers::sleep_nanos(long nanos) {
   } else {
     // Not running as root, not having access to 1Mhz timer. Approximate large
     // durations with nanosleep(); small durations are done with busy wait.
-    if (nanos > (EMPIRICAL_NANOSLEEP_OVERHEAD_US + MINIMUM_NANOSLEEP_TIME_US)*1000) {
-      struct timespec sleep_time
-        = { 0, nanos - EMPIRICAL_NANOSLEEP_OVERHEAD_US*1000 };
+    const long overhead_nanos = s_sleep_timing.nanosleep_overhead_us * 1000;
+    if (nanos > overhead_nanos + MINIMUM_NANOSLEEP_TIME_US*1000) {
+      struct timespec sleep_time = { 0, nanos - overhead_nanos };
       nanosleep(&sleep_time, NULL);
       return;
     }
@@ -533,26 +647,6 @@ static void busy_wait_nanos_rpi_4(long nanos) {
   }
 }
 
-#if DEBUG_SLEEP_JITTER
-static int overshoot_histogram_us[256] = {0};
-static void print_overshoot_histogram() {
-  fprintf(stderr, "Overshoot histogram >= empirical overhead of %dus\n"
-          "%6s | %7s | %7s\n",
-          JitterAllowanceMicroseconds(), "usec", "count", "accum");
-  int total_count = 0;
-  for (int i = 0; i < 256; ++i) total_count += overshoot_histogram_us[i];
-  int running_count = 0;
-  for (int us = 0; us < 256; ++us) {
-    const int count = overshoot_histogram_us[us];
-    if (count > 0) {
-      running_count += count;
-      fprintf(stderr, "%s%3dus: %8d %7.3f%%\n", (us == 0) ? "<=" : " +",
-              us, count, 100.0 * running_count / total_count);
-    }
-  }
-}
-#endif
-
 // A PinPulser that uses the PWM hardware to create accurate pulses.
 // It only works on GPIO-12 or 18 though.
 class HardwarePinPulser : public PinPulser {
@@ -585,10 +679,6 @@ public:
     assert(CanHandle(pins));
     assert(s_CLK_registers && s_PWM_registers && s_Timer1Mhz);
 
-#if DEBUG_SLEEP_JITTER
-    atexit(print_overshoot_histogram);
-#endif
-
     if (LinuxHasModuleLoaded("snd_bcm2835")) {
       fprintf(stderr,
               "\n%s=== snd_bcm2835: found that the Pi sound module is loaded. ===%s\n"
@@ -687,8 +777,9 @@ public:
         struct timespec sleep_time = { 0, 1000 * to_sleep_us };
         nanosleep(&sleep_time, NULL);
 
-#if DEBUG_SLEEP_JITTER
-        {
+        RefreshStats *const stats =
+          s_timing_stats.load(std::memory_order_acquire);
+        if (stats) {
           // Record histogram of realtime jitter how much longer we actually
           // took.
           const int total_us = *s_Timer1Mhz - start_time_;
@@ -696,9 +787,12 @@ public:
           int overshoot = nanoslept_us - (to_sleep_us + JitterAllowanceMicroseconds());
           if (overshoot < 0) overshoot = 0;
           if (overshoot > 255) overshoot = 255;
-          overshoot_histogram_us[overshoot]++;
+          // Only the refresh thread writes, so no need for a locked increment.
+          std::atomic<uint32_t> &count =
+            stats->overshoot_histogram_us[overshoot];
+          count.store(count.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
         }
-#endif
       }
     }
 
@@ -751,6 +845,9 @@ private:
 PinPulser *PinPulser::Create(GPIO *io, uint32_t gpio_mask,
                              bool allow_hardware_pulsing,
                              const std::vector<int> &nano_wait_spec) {
+  if (io->simulation()) {
+    return new SimulatedPinPulser(io->simulation(), gpio_mask, nano_wait_spec);
+  }
   if (!Timers::Init()) return NULL;
   if (allow_hardware_pulsing && HardwarePinPulser::CanHandle(gpio_mask)) {
     return new HardwarePinPulser(gpio_mask, nano_wait_spec);
@@ -759,6 +856,64 @@ PinPulser *PinPulser::Create(GPIO *io, uint32_t gpio_mask,
   }
 }
 
+/*static*/ void PinPulser::SetTimingStats(RefreshStats *stats) {
+  s_timing_stats.store(stats, std::memory_order_release);
+}
+
+/*static*/ const char SleepTiming::kDefaultConfigFile[]
+  = "/etc/rgb-matrix-sleep-timing.conf";
+
+/*static*/ const char *SleepTiming::ConfigFile() {
+  const char *from_env = getenv("RGB_MATRIX_SLEEP_TIMING");
+  return (from_env && *from_env) ? from_env : kDefaultConfigFile;
+}
+
+SleepTiming::SleepTiming()
+  : nanosleep_overhead_us(EMPIRICAL_NANOSLEEP_OVERHEAD_US),
+    jitter_allowance_us(EMPIRICAL_NANOSLEEP_OVERHEAD_US) {
+}
+
+bool SleepTiming::Load(const char *filename) {
+  FILE *f = fopen(filename, "r");
+  if (f == NULL) return false;
+  char buf[256];
+  for (int line = 1; fgets(buf, sizeof(buf), f) != NULL; ++line) {
+    char *const comment = strchr(buf, '#');
+    if (comment) *comment = '\0';
+    char name[64];
+    int value;
+    char trailing;
+    const int fields = sscanf(buf, " %63[a-z_] = %d %c", name, &value,
+                              &trailing);
+    if (fields == EOF) continue;  // Empty line.
+    if (fields != 2 || value < 0) {
+      fprintf(stderr, "%s:%d: ignoring line I don't understand.\n",
+              filename, line);
+    } else if (strcmp(name, "nanosleep_overhead_us") == 0) {
+      nanosleep_overhead_us = value;
+    } else if (strcmp(name, "jitter_allowance_us") == 0) {
+      jitter_allowance_us = value;
+    } else {
+      fprintf(stderr, "%s:%d: unknown value '%s'.\n", filename, line, name);
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+bool SleepTiming::Save(const char *filename, const char *comment) const {
+  FILE *f = fopen(filename, "w");
+  if (f == NULL) return false;
+  for (const char *line = comment; line && *line; /**/) {
+    const char *const end = strchrnul(line, '\n');
+    fprintf(f, "# %.*s\n", (int)(end - line), line);
+    line = *end ? end + 1 : end;
+  }
+  fprintf(f, "nanosleep_overhead_us=%d\n", nanosleep_overhead_us);
+  fprintf(f, "jitter_allowance_us=%d\n", jitter_allowance_us);
+  return fclose(f) == 0;
+}
+
 // For external use, e.g. in the matrix for extra time.
 uint32_t GetMicrosecondCounter() {
   if (s_Timer1Mhz) return *s_Timer1Mhz;
@@ -14,11 +14,14 @@
 // along with this program.  If not, see <http://gnu.org/licenses/gpl-2.0.txt>
 
 #include "graphics.h"
+#include "led-matrix.h"
 #include "utf8-internal.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <functional>
 #include <algorithm>
+#include <string>
 
 namespace rgb_matrix {
 bool SetImage(Canvas *c, int canvas_offset_x, int canvas_offset_y,
@@ -57,6 +60,14 @@ bool SetImage(Canvas *c, int canvas_offset_x, int canvas_offset_y,
   const size_t next_row_skip = skip_start_row + skip_end_row;
   buffer += skip_start_row;
 
+  FrameCanvas *frame = dynamic_cast<FrameCanvas*>(c);
+  if (frame != NULL) {
+    frame->SetImageBulk(canvas_offset_x, canvas_offset_y,
+                        w - canvas_offset_x, h - canvas_offset_y,
+                        buffer, 3 * width, is_bgr);
+    return true;
+  }
+
   if (is_bgr) {
     for (int y = canvas_offset_y; y < h; ++y) {
       for (int x = canvas_offset_x; x < w; ++x) {
@@ -122,14 +133,13 @@ void DrawCircle(Canvas *c, int x0, int y0, int radius, const Color &color) {
   int radiusError = 1 - x;
 
   while (y <= x) {
-    c->SetPixel(x + x0, y + y0, color.r, color.g, color.b);
-    c->SetPixel(y + x0, x + y0, color.r, color.g, color.b);
-    c->SetPixel(-x + x0, y + y0, color.r, color.g, color.b);
-    c->SetPixel(-y + x0, x + y0, color.r, color.g, color.b);
-    c->SetPixel(-x + x0, -y + y0, color.r, color.g, color.b);
-    c->SetPixel(-y + x0, -x + y0, color.r, color.g, color.b);
-    c->SetPixel(x + x0, -y + y0, color.r, color.g, color.b);
-    c->SetPixel(y + x0, -x + y0, color.r, color.g, color.b);
+    const Point octants[8] = {
+      Point(x + x0, y + y0), Point(y + x0, x + y0),
+      Point(-x + x0, y + y0), Point(-y + x0, x + y0),
+      Point(-x + x0, -y + y0), Point(-y + x0, -x + y0),
+      Point(x + x0, -y + y0), Point(y + x0, -x + y0),
+    };
+    c->FillPixels(octants, 8, color);
     y++;
     if (radiusError<0){
       radiusError += 2 * y + 1;
@@ -143,6 +153,14 @@ void DrawCircle(Canvas *c, int x0, int y0, int radius, const Color &color) {
 void DrawLine(Canvas *c, int x0, int y0, int x1, int y1, const Color &color) {
   int dy = y1 - y0, dx = x1 - x0, gradient, x, y, shift = 0x10;
 
+  if (dy == 0) {
+    c->FillSpan(std::min(x0, x1), y0, abs(dx) + 1, color);
+    return;
+  }
+
+  // Points are collected and handed to the canvas in batches.
+  Point points[64];
+  int count = 0;
   if (abs(dx) > abs(dy)) {
     // x variation is bigger than y variation
     if (x1 < x0) {
@@ -152,9 +170,13 @@ void DrawLine(Canvas *c, int x0, int y0, int x1, int y1, const Color &color) {
     gradient = (dy << shift) / dx ;
 
     for (x = x0 , y = 0x8000 + (y0 << shift); x <= x1; ++x, y += gradient) {
-      c->SetPixel(x, y >> shift, color.r, color.g, color.b);
+      points[count++] = Point(x, y >> shift);
+      if (count == 64) {
+        c->FillPixels(points, count, color);
+        count = 0;
+      }
     }
-  } else if (dy != 0) {
+  } else {
     // y variation is bigger than x variation
     if (y1 < y0) {
       std::swap(x0, x1);
@@ -162,11 +184,128 @@ void DrawLine(Canvas *c, int x0, int y0, int x1, int y1, const Color &color) {
     }
     gradient = (dx << shift) / dy;
     for (y = y0 , x = 0x8000 + (x0 << shift); y <= y1; ++y, x += gradient) {
-      c->SetPixel(x >> shift, y, color.r, color.g, color.b);
+      points[count++] = Point(x >> shift, y);
+      if (count == 64) {
+        c->FillPixels(points, count, color);
+        count = 0;
+      }
     }
-  } else {
-    c->SetPixel(x0, y0, color.r, color.g, color.b);
   }
+  c->FillPixels(points, count, color);
+}
+
+namespace {
+struct NamedColor {
+  const char *name;
+  Color color;
+};
+}  // namespace
+
+static const NamedColor kNamedColors[] = {
+  { "black", COLOR_BLACK }, { "white", COLOR_WHITE }, { "red", COLOR_RED },
+  { "pink", COLOR_PINK }, { "purple", COLOR_PURPLE },
+  { "deep-purple", COLOR_DEEP_PURPLE }, { "indigo", COLOR_INDIGO },
+  { "blue", COLOR_BLUE }, { "light-blue", COLOR_LIGHT_BLUE },
+  { "cyan", COLOR_CYAN }, { "teal", COLOR_TEAL }, { "green", COLOR_GREEN },
+  { "light-green", COLOR_LIGHT_GREEN }, { "lime", COLOR_LIME },
+  { "yellow", COLOR_YELLOW }, { "amber", COLOR_AMBER },
+  { "orange", COLOR_ORANGE }, { "deep-orange", COLOR_DEEP_ORANGE },
+  { "brown", COLOR_BROWN }, { "gray", COLOR_GRAY },
+  { "blue-gray", COLOR_BLUE_GRAY },
+};
+
+static bool ParseColor(const std::string &spec, Color *color) {
+  for (size_t i = 0; i < sizeof(kNamedColors) / sizeof(kNamedColors[0]); ++i) {
+    if (spec == kNamedColors[i].name) {
+      *color = kNamedColors[i].color;
+      return true;
+    }
+  }
+  const char *hex = spec.c_str();
+  if (*hex == '#') ++hex;
+  if (strlen(hex) != 6 || strspn(hex, "0123456789abcdefABCDEF") != 6)
+    return false;
+  const long rgb = strtol(hex, NULL, 16);
+  *color = Color((rgb >> 16) & 0xff, (rgb >> 8) & 0xff, rgb & 0xff);
+  return true;
+}
+
+ColorRamp::ColorRamp() {
+  std::vector<Color> stops;
+  stops.push_back(COLOR_YELLOW);
+  stops.push_back(COLOR_RED);
+  SetGradient(stops);
+  SetRange(0, 1, SCALE_LINEAR);
+}
+
+void ColorRamp::SetGradient(const std::vector<Color> &stops, int table_size) {
+  if (stops.empty() || table_size < 1) return;
+  table_.resize(table_size);
+  last_index_ = table_size - 1;
+  const int segments = stops.size() - 1;
+  for (int i = 0; i < table_size; ++i) {
+    // Position of entry i along the stops, and the stops it lies between.
+    const float pos = (table_size > 1) ? float(i) * segments / last_index_ : 0;
+    const int s = std::min((int)pos, std::max(segments - 1, 0));
+    const float t = pos - s;
+    const Color &from = stops[s];
+    const Color &to = stops[std::min(s + 1, segments)];
+    table_[i] = Color(from.r + (to.r - from.r) * t + 0.5f,
+                      from.g + (to.g - from.g) * t + 0.5f,
+                      from.b + (to.b - from.b) * t + 0.5f);
+  }
+}
+
+bool ColorRamp::ParseGradient(const char *spec, int table_size) {
+  std::vector<Color> stops;
+  const char *start = spec;
+  for (;;) {
+    const char *end = strchr(start, ',');
+    const std::string stop = end ? std::string(start, end) : std::string(start);
+    Color color;
+    if (!ParseColor(stop, &color)) return false;
+    stops.push_back(color);
+    if (end == NULL) break;
+    start = end + 1;
+  }
+  SetGradient(stops, table_size);
+  return true;
+}
+
+void ColorRamp::SetRange(float min_value, float max_value, Scale scale) {
+  scale_ = (scale == SCALE_LOG) ? SCALE_LOG : SCALE_LINEAR;
+  if (scale_ == SCALE_LOG) {
+    min_value = log1pf(std::max(min_value, 0.0f));
+    max_value = log1pf(std::max(max_value, 0.0f));
+  }
+  offset_ = min_value;
+  factor_ = (max_value > min_value) ? last_index_ / (max_value - min_value) : 0;
+  quantiles_.clear();
+  quantile_ranks_.clear();
+}
+
+void ColorRamp::SetQuantiles(const float *values, size_t count) {
+  scale_ = SCALE_QUANTILE;
+  std::vector<float> sorted(values, values + count);
+  std::sort(sorted.begin(), sorted.end());
+
+  // Every distinct value gets the color of its middle rank.
+  quantiles_.clear();
+  quantile_ranks_.clear();
+  for (size_t first = 0; first < count; ) {
+    size_t last = first;
+    while (last + 1 < count && sorted[last + 1] == sorted[first]) ++last;
+    const float mid_rank = (first + last) / 2.0f;
+    quantiles_.push_back(sorted[first]);
+    quantile_ranks_.push_back((count > 1) ? mid_rank / (count - 1) : 0);
+    first = last + 1;
+  }
+}
+
+int ColorRamp::QuantileIndex(float value) const {
+  const int i = std::upper_bound(quantiles_.begin(), quantiles_.end(), value)
+    - quantiles_.begin();
+  return (i == 0) ? 0 : (int)(quantile_ranks_[i - 1] * last_index_ + 0.5f);
 }
 
 }//namespace
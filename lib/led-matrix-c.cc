@@ -85,6 +85,11 @@ static struct RGBLedMatrix *led_matrix_create_from_options_optional_edit(
     OPT_COPY_IF_SET(pixel_mapper_config);
     OPT_COPY_IF_SET(panel_type);
     OPT_COPY_IF_SET(limit_refresh_rate_hz);
+    OPT_COPY_IF_SET(refresh_stats_name);
+    OPT_COPY_IF_SET(target_refresh_rate_hz);
+    OPT_COPY_IF_SET(packed_framebuffer);
+    OPT_COPY_IF_SET(white_balance);
+    OPT_COPY_IF_SET(gamma);
 #undef OPT_COPY_IF_SET
   }
 
@@ -119,6 +124,11 @@ static struct RGBLedMatrix *led_matrix_create_from_options_optional_edit(
     ACTUAL_VALUE_BACK_TO_OPT(pixel_mapper_config);
     ACTUAL_VALUE_BACK_TO_OPT(panel_type);
     ACTUAL_VALUE_BACK_TO_OPT(limit_refresh_rate_hz);
+    ACTUAL_VALUE_BACK_TO_OPT(refresh_stats_name);
+    ACTUAL_VALUE_BACK_TO_OPT(target_refresh_rate_hz);
+    ACTUAL_VALUE_BACK_TO_OPT(packed_framebuffer);
+    ACTUAL_VALUE_BACK_TO_OPT(white_balance);
+    ACTUAL_VALUE_BACK_TO_OPT(gamma);
 #undef ACTUAL_VALUE_BACK_TO_OPT
   }
 
@@ -182,6 +192,11 @@ uint8_t led_matrix_get_brightness(struct RGBLedMatrix *matrix) {
   return to_matrix(matrix)->brightness();
 }
 
+void led_matrix_get_active_pwm_bits(struct RGBLedMatrix *matrix,
+                                    int *pwm_bits, int *dither_bits) {
+  to_matrix(matrix)->GetActivePWMBits(pwm_bits, dither_bits);
+}
+
 void led_canvas_get_size(const struct LedCanvas *canvas,
                          int *width, int *height) {
   rgb_matrix::FrameCanvas *c = to_canvas((struct LedCanvas*)canvas);
@@ -203,6 +218,35 @@ void led_canvas_fill(struct LedCanvas *canvas, uint8_t r, uint8_t g, uint8_t b)
   to_canvas(canvas)->Fill(r, g, b);
 }
 
+int led_canvas_compile(struct LedCanvas *canvas) {
+  return to_canvas(canvas)->Compile();
+}
+
+// The C structs are used as the C++ ones directly.
+static_assert(sizeof(LedPoint) == sizeof(rgb_matrix::Point), "Point layout");
+static_assert(sizeof(LedColor) == sizeof(rgb_matrix::Color), "Color layout");
+
+void led_canvas_set_pixels(struct LedCanvas *canvas,
+                           const struct LedPoint *points,
+                           const struct LedColor *colors, int count) {
+  to_canvas(canvas)->SetPixels(
+    reinterpret_cast<const rgb_matrix::Point*>(points),
+    reinterpret_cast<const rgb_matrix::Color*>(colors), count);
+}
+
+void led_canvas_fill_pixels(struct LedCanvas *canvas,
+                            const struct LedPoint *points, int count,
+                            uint8_t r, uint8_t g, uint8_t b) {
+  to_canvas(canvas)->FillPixels(
+    reinterpret_cast<const rgb_matrix::Point*>(points), count,
+    rgb_matrix::Color(r, g, b));
+}
+
+void led_canvas_fill_span(struct LedCanvas *canvas, int x, int y, int width,
+                          uint8_t r, uint8_t g, uint8_t b) {
+  to_canvas(canvas)->FillSpan(x, y, width, rgb_matrix::Color(r, g, b));
+}
+
 struct LedFont *load_font(const char *bdf_font_file) {
   rgb_matrix::Font* font = new rgb_matrix::Font();
   font->LoadFont(bdf_font_file);
@@ -16,6 +16,7 @@
 #include "led-matrix.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <math.h>
 #include <pthread.h>
 #include <stdint.h>
@@ -25,10 +26,14 @@
 #include <stdio.h>
 #include <sys/time.h>
 
+#include <algorithm>
+#include <atomic>
+
 #include "gpio.h"
 #include "thread.h"
 #include "framebuffer-internal.h"
 #include "multiplex-mappers-internal.h"
+#include "refresh-stats.h"
 
 // Leave this in here for a while. Setting things from old defines.
 #if defined(ADAFRUIT_RGBMATRIX_HAT)
@@ -49,44 +54,72 @@
 namespace rgb_matrix {
 using namespace internal;
 
+// The lowest bitplane shown in each frame of a sequence of four, by number of
+// dither bits: the low bits are only shown in some frames, and get shorter
+// output-enable pulses to make up for that (see Framebuffer::InitGPIO()).
+static const int kDitherStartBit[kMaxDitherBits + 1][4] = {
+  { 0, 0, 0, 0 },
+  { 0, 1, 0, 1 },
+  { 0, 1, 2, 2 },
+};
+
 // Pump pixels to screen. Needs to be high priority real-time because jitter
 class RGBMatrix::UpdateThread : public Thread {
 public:
   UpdateThread(GPIO *io, FrameCanvas *initial_frame,
-               int pwm_dither_bits, bool show_refresh,
-               int limit_refresh_hz)
+               int pwm_bits, int pwm_dither_bits, bool show_refresh,
+               int limit_refresh_hz, int target_refresh_hz,
+               const char *stats_name)
     : io_(io), show_refresh_(show_refresh),
       target_frame_usec_(limit_refresh_hz < 1 ? 0 : 1e6/limit_refresh_hz),
-      running_(true),
+      target_dump_usec_(target_refresh_hz < 1 ? 0 : 1e6/target_refresh_hz),
+      max_pwm_bits_(pwm_bits), min_dither_bits_(pwm_dither_bits),
+      max_level_(0), level_(0), changed_from_(-1), previous_mean_usec_(0),
+      window_usec_(0), window_max_usec_(0), window_frames_(0),
+      good_windows_(0),
+      pwm_bits_(target_dump_usec_ ? pwm_bits : kBitPlanes),
+      dither_bits_(pwm_dither_bits),
+      stats_(NULL),
+      running_(true), input_waiters_(0), gpio_inputs_(0),
       current_frame_(initial_frame), next_frame_(NULL),
-      requested_frame_multiple_(1) {
+      requested_frame_multiple_(1), vsync_waiters_(0), published_frame_(0) {
     pthread_cond_init(&frame_done_, NULL);
     pthread_cond_init(&input_change_, NULL);
-    switch (pwm_dither_bits) {
-    case 0:
-      start_bit_[0] = 0; start_bit_[1] = 0;
-      start_bit_[2] = 0; start_bit_[3] = 0;
-      break;
-    case 1:
-      start_bit_[0] = 0; start_bit_[1] = 1;
-      start_bit_[2] = 0; start_bit_[3] = 1;
-      break;
-    case 2:
-      start_bit_[0] = 0; start_bit_[1] = 1;
-      start_bit_[2] = 2; start_bit_[3] = 2;
-      break;
+    if (target_dump_usec_) {
+      int pwm, dither;
+      while (max_level_ < kMaxLevels - 1 && LevelBits(max_level_ + 1,
+                                                      &pwm, &dither)) {
+        ++max_level_;
+      }
+      for (int i = 0; i < kMaxLevels; ++i) step_ratio_[i] = 1.0f;
+    }
+    if (stats_name && *stats_name) {
+      stats_ = RefreshStats::Create(stats_name);
+      if (stats_) {
+        PinPulser::SetTimingStats(stats_);
+      } else {
+        fprintf(stderr, "Can't create refresh statistics '%s': %s\n",
+                stats_name, strerror(errno));
+      }
+    }
+  }
+
+  virtual ~UpdateThread() {
+    if (stats_) {
+      PinPulser::SetTimingStats(NULL);
+      RefreshStats::Close(stats_);
     }
   }
 
   void Stop() {
-    MutexLock l(&running_mutex_);
-    running_ = false;
+    running_.store(false, std::memory_order_release);
   }
 
   virtual void Run() {
     unsigned frame_count = 0;
     unsigned low_bit_sequence = 0;
     uint32_t largest_time = 0;
+    uint32_t printed_largest_time = 0;
     uint32_t last_gpio_bits = 0;
 
     // Let's start measure max time only after a we were running for a few
@@ -94,15 +127,32 @@ public:
     static const int kHoldffTimeUs = 2000 * 1000;
     uint32_t initial_holdoff_start = GetMicrosecondCounter();
     bool max_measure_enabled = false;
+    uint32_t last_print_us = initial_holdoff_start;
 
     while (running()) {
       const uint32_t start_time_us = GetMicrosecondCounter();
 
-      current_frame_->framebuffer()
-        ->DumpToMatrix(io_, start_bit_[low_bit_sequence % 4]);
+      const int dither_bits = dither_bits_.load(std::memory_order_relaxed);
+      const int low_bit = std::max(
+        kBitPlanes - pwm_bits_.load(std::memory_order_relaxed),
+        kDitherStartBit[dither_bits][low_bit_sequence % 4]);
+      current_frame_->framebuffer()->DumpToMatrix(io_, low_bit, dither_bits);
+      if (target_dump_usec_) {
+        AdaptPWMBits(GetMicrosecondCounter() - start_time_us);
+      }
+
+      // PublishFrame() exchange: the newest published frame becomes current,
+      // the current one goes back to the producer. No lock needed.
+      if (published_frame_.load(std::memory_order_acquire) & kFreshFrame) {
+        const uintptr_t published = published_frame_.exchange(
+          reinterpret_cast<uintptr_t>(current_frame_),
+          std::memory_order_acq_rel);
+        current_frame_ = reinterpret_cast<FrameCanvas*>(published
+                                                        & ~kFreshFrame);
+      }
 
-      // SwapOnVSync() exchange.
-      {
+      // SwapOnVSync() exchange. Only locks if someone is waiting.
+      if (vsync_waiters_.load(std::memory_order_acquire) > 0) {
         MutexLock l(&frame_sync_);
         // Do fast equality test first (likely due to frame_count reset).
         if (frame_count == requested_frame_multiple_
@@ -122,9 +172,11 @@ public:
       const uint32_t inputs = io_->Read();
       if (inputs != last_gpio_bits) {
         last_gpio_bits = inputs;
-        MutexLock l(&input_sync_);
-        gpio_inputs_ = inputs;
-        pthread_cond_signal(&input_change_);
+        gpio_inputs_.store(inputs, std::memory_order_release);
+        if (input_waiters_.load(std::memory_order_acquire) > 0) {
+          MutexLock l(&input_sync_);
+          pthread_cond_signal(&input_change_);
+        }
       }
 
       ++frame_count;
@@ -137,17 +189,30 @@ public:
       }
 
       const uint32_t end_time_us = GetMicrosecondCounter();
+      const uint32_t usec = end_time_us - start_time_us;
+      if (!max_measure_enabled) {
+        // Don't measure at startup, as times will be janky.
+        max_measure_enabled = (end_time_us - initial_holdoff_start) > kHoldffTimeUs;
+      }
+      if (stats_) {
+        UpdateStats(usec, max_measure_enabled);
+      }
       if (show_refresh_) {
-        uint32_t usec = end_time_us - start_time_us;
-        printf("\b\b\b\b\b\b\b\b%6.1fHz", 1e6 / usec);
         if (usec > largest_time && max_measure_enabled) {
           largest_time = usec;
-          const float lowest_hz = 1e6 / largest_time;
-          printf(" (lowest: %.1fHz)"
-                 "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b", lowest_hz);
-        } else {
-          // Don't measure at startup, as times will be janky.
-          max_measure_enabled = (end_time_us - initial_holdoff_start) > kHoldffTimeUs;
+        }
+        // Printing takes long enough to show in the refresh rate itself,
+        // so only do it a few times per second.
+        if (end_time_us - last_print_us >= kShowRefreshIntervalUs) {
+          last_print_us = end_time_us;
+          printf("\b\b\b\b\b\b\b\b%6.1fHz", 1e6 / usec);
+          if (largest_time != printed_largest_time) {
+            printed_largest_time = largest_time;
+            const float lowest_hz = 1e6 / largest_time;
+            printf(" (lowest: %.1fHz)"
+                   "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b", lowest_hz);
+          }
+          fflush(stdout);
         }
       }
     }
@@ -158,39 +223,182 @@ public:
     FrameCanvas *previous = current_frame_;
     next_frame_ = other;
     requested_frame_multiple_ = frame_fraction;
+    vsync_waiters_.fetch_add(1, std::memory_order_release);
     frame_sync_.WaitOn(&frame_done_);
+    vsync_waiters_.fetch_sub(1, std::memory_order_relaxed);
     return previous;
   }
 
+  // Returns the frame published before and not shown since, or the one
+  // shown before "frame" is picked up, or NULL on the first call.
+  FrameCanvas *PublishFrame(FrameCanvas *frame) {
+    const uintptr_t previous = published_frame_.exchange(
+      reinterpret_cast<uintptr_t>(frame) | kFreshFrame,
+      std::memory_order_acq_rel);
+    if (stats_ && (previous & kFreshFrame)) {
+      stats_->missed_swaps.fetch_add(1, std::memory_order_relaxed);
+    }
+    return reinterpret_cast<FrameCanvas*>(previous & ~kFreshFrame);
+  }
+
+  void GetPWMBits(int *pwm_bits, int *dither_bits) {
+    *pwm_bits = pwm_bits_.load(std::memory_order_relaxed);
+    *dither_bits = dither_bits_.load(std::memory_order_relaxed);
+  }
+
   uint32_t AwaitInputChange(int timeout_ms) {
     MutexLock l(&input_sync_);
+    input_waiters_.fetch_add(1, std::memory_order_release);
     input_sync_.WaitOn(&input_change_, timeout_ms);
-    return gpio_inputs_;
+    input_waiters_.fetch_sub(1, std::memory_order_relaxed);
+    return gpio_inputs_.load(std::memory_order_acquire);
   }
 
 private:
   inline bool running() {
-    MutexLock l(&running_mutex_);
-    return running_;
+    return running_.load(std::memory_order_acquire);
+  }
+
+  // The quality ladder of --led-target-refresh, from the configured bits at
+  // level 0 down: first fewer PWM bits, which only loses the darkest shades,
+  // down to kMinPWMBitsBeforeDither. Then more dither bits, which also
+  // halves the brightness per bit, and then fewer PWM bits again. Each level
+  // is faster than the one before. Returns false past the last level.
+  bool LevelBits(int level, int *pwm_bits, int *dither_bits) const {
+    const int floor = std::min(max_pwm_bits_, kMinPWMBitsBeforeDither);
+    *pwm_bits = max_pwm_bits_ - level;
+    *dither_bits = min_dither_bits_;
+    if (*pwm_bits >= floor) return true;
+    *dither_bits += floor - *pwm_bits;
+    *pwm_bits = floor;
+    if (*dither_bits <= kMaxDitherBits) return true;
+    *pwm_bits -= *dither_bits - kMaxDitherBits;
+    *dither_bits = kMaxDitherBits;
+    return *pwm_bits >= 1;
+  }
+
+  // Called with the time of each DumpToMatrix(). Once per window, steps
+  // down the ladder if the mean was slower than the target. Steps back up if
+  // the level above, estimated with the ratio measured when we were last
+  // there, fits with kAdaptHeadroom to spare for kRaiseWindows in a row.
+  // The slowest frame of a window doesn't count: that is typically the
+  // kernel taking the CPU away, which fewer bits won't fix.
+  void AdaptPWMBits(uint32_t dump_usec) {
+    window_usec_ += dump_usec;
+    window_max_usec_ = std::max(window_max_usec_, dump_usec);
+    ++window_frames_;
+    // Whole dither sequences only, so that windows are comparable.
+    if (window_usec_ < kAdaptWindowUs || window_frames_ % 4 != 0) return;
+    const float mean_usec =
+      float(window_usec_ - window_max_usec_) / (window_frames_ - 1);
+    window_usec_ = 0;
+    window_max_usec_ = 0;
+    window_frames_ = 0;
+
+    if (changed_from_ >= 0) {
+      // First window after a change. Remember what the step was worth.
+      step_ratio_[std::min(changed_from_, level_)] = changed_from_ < level_
+        ? previous_mean_usec_ / mean_usec
+        : mean_usec / previous_mean_usec_;
+      changed_from_ = -1;
+    }
+
+    if (mean_usec > target_dump_usec_) {
+      good_windows_ = 0;
+      if (level_ < max_level_) SetLevel(level_ + 1, mean_usec);
+    } else if (level_ > 0 && mean_usec * step_ratio_[level_ - 1]
+               < target_dump_usec_ * (1 - kAdaptHeadroom)) {
+      if (++good_windows_ >= kRaiseWindows) {
+        good_windows_ = 0;
+        SetLevel(level_ - 1, mean_usec);
+      }
+    } else {
+      good_windows_ = 0;
+    }
+  }
+
+  void SetLevel(int level, float mean_usec) {
+    int pwm, dither;
+    LevelBits(level, &pwm, &dither);
+    changed_from_ = level_;
+    previous_mean_usec_ = mean_usec;
+    level_ = level;
+    pwm_bits_.store(pwm, std::memory_order_relaxed);
+    dither_bits_.store(dither, std::memory_order_relaxed);
+  }
+
+  // Only the refresh thread writes these, so a relaxed load and store is
+  // enough; readers in other processes just must not see torn values.
+  static void Increment(std::atomic<uint32_t> *counter) {
+    counter->store(counter->load(std::memory_order_relaxed) + 1,
+                   std::memory_order_relaxed);
+  }
+
+  void UpdateStats(uint32_t usec, bool measure_extremes) {
+    Increment(&stats_->frame_count);
+    Increment(&stats_->frame_histogram[RefreshStats::FrameBucket(usec)]);
+    stats_->last_frame_us.store(usec, std::memory_order_relaxed);
+    if (!measure_extremes) return;
+    if (usec > stats_->max_frame_us.load(std::memory_order_relaxed)) {
+      stats_->max_frame_us.store(usec, std::memory_order_relaxed);
+    }
+    const uint32_t min_usec =
+      stats_->min_frame_us.load(std::memory_order_relaxed);
+    if (min_usec == 0 || usec < min_usec) {
+      stats_->min_frame_us.store(usec, std::memory_order_relaxed);
+    }
   }
 
   GPIO *const io_;
   const bool show_refresh_;
   const uint32_t target_frame_usec_;
-  uint32_t start_bit_[4];
-
-  Mutex running_mutex_;
-  bool running_;
-
+  static const uint32_t kShowRefreshIntervalUs = 100 * 1000;
+
+  // --led-target-refresh; see AdaptPWMBits().
+  static const int kMinPWMBitsBeforeDither = 7;
+  static const int kMaxLevels = kBitPlanes + kMaxDitherBits;
+  static const uint32_t kAdaptWindowUs = 100 * 1000;
+  static const int kRaiseWindows = 3;
+  static constexpr float kAdaptHeadroom = 0.1f;
+  const uint32_t target_dump_usec_;   // 0 if not adapting.
+  const int max_pwm_bits_;
+  const int min_dither_bits_;
+  int max_level_;
+  int level_;
+  int changed_from_;  // Level before the last change, until measured.
+  float previous_mean_usec_;
+  float step_ratio_[kMaxLevels];  // Time at level i / time at level i + 1.
+  uint32_t window_usec_;
+  uint32_t window_max_usec_;
+  int window_frames_;
+  int good_windows_;
+
+  // What DumpToMatrix() shows; read by GetPWMBits() from other threads.
+  std::atomic<int> pwm_bits_;
+  std::atomic<int> dither_bits_;
+
+  RefreshStats *stats_;  // NULL if not enabled.
+
+  std::atomic<bool> running_;
+
+  // The refresh loop only locks input_sync_ to wake up AwaitInputChange().
   Mutex input_sync_;
   pthread_cond_t input_change_;
-  uint32_t gpio_inputs_;
+  std::atomic<int> input_waiters_;
+  std::atomic<uint32_t> gpio_inputs_;
 
   Mutex frame_sync_;
   pthread_cond_t frame_done_;
   FrameCanvas *current_frame_;
   FrameCanvas *next_frame_;
   unsigned requested_frame_multiple_;
+  std::atomic<int> vsync_waiters_;  // Threads in SwapOnVSync().
+
+  // The third buffer of PublishFrame(): the frame between producer and
+  // refresh thread. Flagged with kFreshFrame until the refresh thread took
+  // it, so that it can swap in a frame only once.
+  static const uintptr_t kFreshFrame = 1;
+  std::atomic<uintptr_t> published_frame_;
 };
 
 // Some defaults. See options-initialize.cc for the command line parsing.
@@ -245,10 +453,15 @@ RGBMatrix::Options::Options() :
   pixel_mapper_config(NULL),
   panel_type(NULL),
 #ifdef FIXED_FRAME_MICROSECONDS
-  limit_refresh_rate_hz(1e6 / FIXED_FRAME_MICROSECONDS)
+  limit_refresh_rate_hz(1e6 / FIXED_FRAME_MICROSECONDS),
 #else
-  limit_refresh_rate_hz(0)
+  limit_refresh_rate_hz(0),
 #endif
+  refresh_stats_name(NULL),
+  target_refresh_rate_hz(0),
+  packed_framebuffer(false),
+  white_balance(NULL),
+  gamma(NULL)
 {
   // Nothing to see here.
 }
@@ -279,6 +492,9 @@ static void PrintOptions(const RGBMatrix::Options &o) {
   P_STR(pixel_mapper_config);
   P_STR(panel_type);
   P_INT(limit_refresh_rate_hz);
+  P_STR(refresh_stats_name);
+  P_INT(target_refresh_rate_hz);
+  P_BOOL(packed_framebuffer);
 #undef P_INT
 #undef P_STR
 #undef P_BOOL
@@ -346,7 +562,7 @@ RGBMatrix::~RGBMatrix() {
 
   // Make sure LEDs are off.
   active_->Clear();
-  if (io_) active_->framebuffer()->DumpToMatrix(io_, 0);
+  if (io_) active_->framebuffer()->DumpToMatrix(io_, 0, 0);
 
   for (size_t i = 0; i < created_frames_.size(); ++i) {
     delete created_frames_[i];
@@ -384,7 +600,7 @@ void RGBMatrix::SetGPIO(GPIO *io, bool start_thread) {
     io_ = io;
     Framebuffer::InitGPIO(io_, params_.rows, params_.parallel,
                           !params_.disable_hardware_pulsing,
-                          params_.pwm_lsb_nanoseconds, params_.pwm_dither_bits,
+                          params_.pwm_lsb_nanoseconds,
                           params_.row_address_type);
     Framebuffer::InitializePanels(io_, params_.panel_type,
                                   params_.cols * params_.chain_length);
@@ -396,9 +612,12 @@ void RGBMatrix::SetGPIO(GPIO *io, bool start_thread) {
 
 bool RGBMatrix::StartRefresh() {
   if (updater_ == NULL && io_ != NULL) {
-    updater_ = new UpdateThread(io_, active_, params_.pwm_dither_bits,
+    updater_ = new UpdateThread(io_, active_, params_.pwm_bits,
+                                params_.pwm_dither_bits,
                                 params_.show_refresh_rate,
-                                params_.limit_refresh_rate_hz);
+                                params_.limit_refresh_rate_hz,
+                                params_.target_refresh_rate_hz,
+                                params_.refresh_stats_name);
     // If we have multiple processors, the kernel
     // jumps around between these, creating some global flicker.
     // So let's tie it to the last CPU available.
@@ -419,6 +638,7 @@ FrameCanvas *RGBMatrix::CreateFrameCanvas() {
                                     params_.scan_mode,
                                     params_.led_rgb_sequence,
                                     params_.inverse_colors,
+                                    params_.packed_framebuffer,
                                     &shared_pixel_mapper_));
   if (created_frames_.empty()) {
     // First time. Get defaults from initial Framebuffer.
@@ -428,6 +648,10 @@ FrameCanvas *RGBMatrix::CreateFrameCanvas() {
   result->framebuffer()->SetPWMBits(params_.pwm_bits);
   result->framebuffer()->set_luminance_correct(do_luminance_correct_);
   result->framebuffer()->SetBrightness(params_.brightness);
+  internal::ColorCorrection correction;
+  std::string error;
+  if (correction.Parse(params_.white_balance, params_.gamma, &error))
+    result->framebuffer()->SetColorCorrection(correction);
 
   created_frames_.push_back(result);
   return result;
@@ -441,6 +665,18 @@ FrameCanvas *RGBMatrix::SwapOnVSync(FrameCanvas *other,
   return previous;
 }
 
+FrameCanvas *RGBMatrix::PublishFrame(FrameCanvas *frame) {
+  FrameCanvas *previous;
+  if (updater_) {
+    previous = updater_->PublishFrame(frame);
+    if (previous == NULL) previous = CreateFrameCanvas();  // The third one.
+  } else {
+    previous = active_;
+  }
+  active_ = frame;
+  return previous;
+}
+
 uint32_t RGBMatrix::AwaitInputChange(int timeout_ms) {
   if (!updater_) return 0;
   return updater_->AwaitInputChange(timeout_ms);
@@ -455,6 +691,16 @@ bool RGBMatrix::SetPWMBits(uint8_t value) {
 }
 uint8_t RGBMatrix::pwmbits() { return params_.pwm_bits; }
 
+void RGBMatrix::GetActivePWMBits(int *pwm_bits, int *dither_bits) {
+  if (updater_) {
+    updater_->GetPWMBits(pwm_bits, dither_bits);
+    *pwm_bits = std::min(*pwm_bits, int(params_.pwm_bits));
+  } else {
+    *pwm_bits = params_.pwm_bits;
+    *dither_bits = params_.pwm_dither_bits;
+  }
+}
+
 // Map brightness of output linearly to input with CIE1931 profile.
 void RGBMatrix::set_luminance_correct(bool on) {
   active_->framebuffer()->set_luminance_correct(on);
@@ -496,6 +742,20 @@ void RGBMatrix::Fill(uint8_t red, uint8_t green, uint8_t blue) {
   active_->Fill(red, green, blue);
 }
 
+void RGBMatrix::SetPixels(const Point *points, const Color *colors,
+                          int count) {
+  active_->SetPixels(points, colors, count);
+}
+
+void RGBMatrix::FillPixels(const Point *points, int count,
+                           const Color &color) {
+  active_->FillPixels(points, count, color);
+}
+
+void RGBMatrix::FillSpan(int x, int y, int width, const Color &color) {
+  active_->FillSpan(x, y, width, color);
+}
+
 bool RGBMatrix::ApplyPixelMapper(const PixelMapper *mapper) {
   if (mapper == NULL) return true;
   using internal::PixelDesignatorMap;
@@ -506,21 +766,21 @@ bool RGBMatrix::ApplyPixelMapper(const PixelMapper *mapper) {
     return false;
   }
   PixelDesignatorMap *new_mapper = new PixelDesignatorMap(
-    new_width, new_height, shared_pixel_mapper_->GetFillColorBits());
+    new_width, new_height, *shared_pixel_mapper_);
   for (int y = 0; y < new_height; ++y) {
     for (int x = 0; x < new_width; ++x) {
       int orig_x = -1, orig_y = -1;
       mapper->MapVisibleToMatrix(old_width, old_height,
                                  x, y, &orig_x, &orig_y);
+      if (orig_x < 0 && orig_y < 0)
+        continue;  // Not shown, e.g. a gap between panels.
       if (orig_x < 0 || orig_y < 0 ||
           orig_x >= old_width || orig_y >= old_height) {
         fprintf(stderr, "Error in PixelMapper: (%d, %d) -> (%d, %d) [range: "
                 "%dx%d]\n", x, y, orig_x, orig_y, old_width, old_height);
         continue;
       }
-      const internal::PixelDesignator *orig_designator;
-      orig_designator = shared_pixel_mapper_->get(orig_x, orig_y);
-      *new_mapper->get(x, y) = *orig_designator;
+      *new_mapper->get(x, y) = *shared_pixel_mapper_->get(orig_x, orig_y);
     }
   }
   delete shared_pixel_mapper_;
@@ -536,10 +796,32 @@ void FrameCanvas::SetPixel(int x, int y,
                          uint8_t red, uint8_t green, uint8_t blue) {
   frame_->SetPixel(x, y, red, green, blue);
 }
+void FrameCanvas::set_color_cache(bool on) { frame_->set_color_cache(on); }
+bool FrameCanvas::color_cache() const { return frame_->color_cache(); }
+void FrameCanvas::GetColorCacheStats(uint64_t *hits, uint64_t *misses) const {
+  frame_->GetColorCacheStats(hits, misses);
+}
+void FrameCanvas::ResetColorCacheStats() { frame_->ResetColorCacheStats(); }
+void FrameCanvas::SetImageBulk(int x, int y, int width, int height,
+                               const uint8_t *image, size_t stride,
+                               bool is_bgr) {
+  frame_->SetImageBulk(x, y, width, height, image, stride, is_bgr);
+}
 void FrameCanvas::Clear() { return frame_->Clear(); }
 void FrameCanvas::Fill(uint8_t red, uint8_t green, uint8_t blue) {
   frame_->Fill(red, green, blue);
 }
+void FrameCanvas::SetPixels(const Point *points, const Color *colors,
+                            int count) {
+  frame_->SetPixels(points, colors, count);
+}
+void FrameCanvas::FillPixels(const Point *points, int count,
+                             const Color &color) {
+  frame_->FillPixels(points, count, color);
+}
+void FrameCanvas::FillSpan(int x, int y, int width, const Color &color) {
+  frame_->FillSpan(x, y, width, color);
+}
 bool FrameCanvas::SetPWMBits(uint8_t value) { return frame_->SetPWMBits(value); }
 uint8_t FrameCanvas::pwmbits() { return frame_->pwmbits(); }
 
@@ -559,4 +841,10 @@ bool FrameCanvas::Deserialize(const char *data, size_t len) {
 void FrameCanvas::CopyFrom(const FrameCanvas &other) {
   frame_->CopyFrom(other.frame_);
 }
+void FrameCanvas::MarkClean() { frame_->MarkClean(); }
+size_t FrameCanvas::DirtySize() const { return frame_->DirtySize(); }
+void FrameCanvas::CopyDirtyFrom(const FrameCanvas &other) {
+  frame_->CopyDirtyFrom(other.frame_);
+}
+bool FrameCanvas::Compile() { return frame_->Compile(); }
 }  // end namespace rgb_matrix
@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <grp.h>
@@ -25,6 +26,7 @@
 
 #include <vector>
 
+#include "framebuffer-internal.h"
 #include "multiplex-mappers-internal.h"
 
 namespace rgb_matrix {
@@ -153,6 +155,14 @@ static bool FlagInit(int &argc, char **&argv,
       if (ConsumeStringFlag("panel-type", it, end,
                             &mopts->panel_type, &err))
         continue;
+      if (ConsumeStringFlag("refresh-stats", it, end,
+                            &mopts->refresh_stats_name, &err))
+        continue;
+      if (ConsumeStringFlag("white-balance", it, end,
+                            &mopts->white_balance, &err))
+        continue;
+      if (ConsumeStringFlag("gamma", it, end, &mopts->gamma, &err))
+        continue;
       if (ConsumeIntFlag("rows", it, end, &mopts->rows, &err))
         continue;
       if (ConsumeIntFlag("cols", it, end, &mopts->cols, &err))
@@ -181,10 +191,16 @@ static bool FlagInit(int &argc, char **&argv,
       if (ConsumeIntFlag("limit-refresh", it, end,
                          &mopts->limit_refresh_rate_hz, &err))
         continue;
+      if (ConsumeIntFlag("target-refresh", it, end,
+                         &mopts->target_refresh_rate_hz, &err))
+        continue;
       if (ConsumeBoolFlag("show-refresh", it, &mopts->show_refresh_rate))
         continue;
       if (ConsumeBoolFlag("inverse", it, &mopts->inverse_colors))
         continue;
+      if (ConsumeBoolFlag("packed-framebuffer", it,
+                          &mopts->packed_framebuffer))
+        continue;
       // We don't have a swap_green_blue option anymore, but we simulate the
       // flag for a while.
       bool swap_green_blue;
@@ -289,8 +305,31 @@ bool ParseOptionsFromFlags(int *argc, char ***argv,
   return FlagInit(*argc, *argv, mopt, ropt, remove_consumed_options);
 }
 
-RGBMatrix *CreateMatrixFromOptions(const RGBMatrix::Options &options,
+// The GPIO mapping "simulated" or "simulated:<mapping>", or the environment
+// variable RGB_MATRIX_SIMULATE_GPIO, select the in-memory SimulatedGPIO
+// instead of the hardware. Strips the prefix from the mapping name.
+static bool UseSimulatedGPIO(RGBMatrix::Options *options) {
+  static const char kPrefix[] = "simulated";
+  const char *mapping = options->hardware_mapping;
+  if (mapping != NULL
+      && strncasecmp(mapping, kPrefix, strlen(kPrefix)) == 0
+      && (mapping[strlen(kPrefix)] == '\0'
+          || mapping[strlen(kPrefix)] == ':')) {
+    mapping += strlen(kPrefix);
+    options->hardware_mapping = (*mapping == ':')
+      ? mapping + 1
+      : RGBMatrix::Options().hardware_mapping;
+    return true;
+  }
+  const char *env = getenv("RGB_MATRIX_SIMULATE_GPIO");
+  return env != NULL && *env != '\0' && strcmp(env, "0") != 0;
+}
+
+RGBMatrix *CreateMatrixFromOptions(const RGBMatrix::Options &user_options,
                                    const RuntimeOptions &runtime_options) {
+  RGBMatrix::Options options = user_options;
+  const bool simulate_gpio = UseSimulatedGPIO(&options);
+
   std::string error;
   if (!options.Validate(&error)) {
     fprintf(stderr, "%s\n", error.c_str());
@@ -305,7 +344,10 @@ RGBMatrix *CreateMatrixFromOptions(const RGBMatrix::Options &options,
   }
 
   static GPIO io;  // This static var is a little bit icky.
-  if (runtime_options.do_gpio_init &&
+  static SimulatedGPIO simulated_io;
+  if (runtime_options.do_gpio_init && simulate_gpio) {
+    io.InitSimulated(&simulated_io);
+  } else if (runtime_options.do_gpio_init &&
       !io.Init(runtime_options.gpio_slowdown)) {
     fprintf(stderr, "Must run as root to be able to access /dev/mem\n"
             "Prepend 'sudo' to the command\n");
@@ -375,6 +417,7 @@ void PrintMatrixFlags(FILE *out, const RGBMatrix::Options &d,
 
   fprintf(out,
           "\t--led-gpio-mapping=<name> : Name of GPIO mapping used. Default \"%s\"\n"
+          "\t                            Prefix with \"simulated:\" to write to memory instead of the GPIO pins.\n"
           "\t--led-rows=<rows>         : Panel rows. Typically 8, 16, 32 or 64."
           " (Default: %d).\n"
           "\t--led-cols=<cols>         : Panel columns. Typically 32 or 64. "
@@ -389,6 +432,10 @@ void PrintMatrixFlags(FILE *out, const RGBMatrix::Options &d,
           "\t                            Available: %s. Default: \"\"\n"
           "\t--led-pwm-bits=<1..11>    : PWM bits (Default: %d).\n"
           "\t--led-brightness=<percent>: Brightness in percent (Default: %d).\n"
+          "\t--led-white-balance=<r>,<g>,<b>: Brightness of each color in "
+          "percent (Default: 100,100,100).\n"
+          "\t--led-gamma=<gamma>|<r>,<g>,<b>: Gamma curves instead of CIE1931 "
+          "luminance correction.\n"
           "\t--led-scan-mode=<0..1>    : 0 = progressive; 1 = interlaced "
           "(Default: %d).\n"
           "\t--led-row-addr-type=<0..4>: 0 = default; 1 = AB-addressed panels; 2 = direct row select; 3 = ABC-addressed panels; 4 = ABC Shift + DE direct "
@@ -396,8 +443,14 @@ void PrintMatrixFlags(FILE *out, const RGBMatrix::Options &d,
           "\t--led-%sshow-refresh        : %show refresh rate.\n"
           "\t--led-limit-refresh=<Hz>  : Limit refresh rate to this frequency in Hz. Useful to keep a\n"
           "\t                            constant refresh rate on loaded system. 0=no limit. Default: %d\n"
+          "\t--led-target-refresh=<Hz> : Lower PWM bits, then dither more, as needed to refresh at\n"
+          "\t                            least this often. 0=fixed bits. Default: %d\n"
+          "\t--led-refresh-stats=<name>: Keep refresh statistics in shared memory /dev/shm/<name>.\n"
+          "\t                            Watch them with the refresh-stats tool.\n"
           "\t--led-%sinverse             "
           ": Switch if your matrix has inverse colors %s.\n"
+          "\t--led-%spacked-framebuffer  : %s only the color bits of frames, "
+          "expanded while refreshing.\n"
           "\t--led-rgb-sequence        : Switch if your matrix has led colors "
           "swapped (Default: \"RGB\")\n"
           "\t--led-pwm-lsb-nanoseconds : PWM Nanoseconds for LSB "
@@ -412,8 +465,10 @@ void PrintMatrixFlags(FILE *out, const RGBMatrix::Options &d,
           available_mappers.c_str(),
           d.pwm_bits, d.brightness, d.scan_mode,
           d.show_refresh_rate ? "no-" : "", d.show_refresh_rate ? "Don't s" : "S",
-          d.limit_refresh_rate_hz,
+          d.limit_refresh_rate_hz, d.target_refresh_rate_hz,
           d.inverse_colors ? "no-" : "",    d.inverse_colors ? "off" : "on",
+          d.packed_framebuffer ? "no-" : "",
+          d.packed_framebuffer ? "Don't store" : "Store",
           d.pwm_lsb_nanoseconds,
           !d.disable_hardware_pulsing ? "no-" : "",
           !d.disable_hardware_pulsing ? "Don't u" : "U");
@@ -481,6 +536,10 @@ bool RGBMatrix::Options::Validate(std::string *err_in) const {
     success = false;
   }
 
+  internal::ColorCorrection correction;
+  if (!correction.Parse(white_balance, gamma, err))
+    success = false;
+
   if (pwm_bits <= 0 || pwm_bits > 11) {
     err->append("Invalid range of pwm-bits (1..11 allowed).\n");
     success = false;
@@ -16,10 +16,12 @@
 #include "pixel-mapper.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
 #include <map>
 
 namespace rgb_matrix {
@@ -278,6 +280,145 @@ private:
 };
 
 
+// Arranges panels freely as described in a layout file, e.g. panels mounted
+// in different orientations or with gaps between them. The parameter is the
+// name of the file, which has one line per visible panel:
+//   <chain-position> <parallel-chain> <x> <y> [<rotation>]
+// The panel at <chain-position> (0 is closest to the Pi) of <parallel-chain>
+// gets its top left corner at visible (<x>, <y>), rotated clockwise by
+// <rotation> degrees (0, 90, 180 or 270). Text after '#' is ignored.
+// Panels that are not listed are not visible; the visible size is the
+// bounding box of the listed panels.
+//
+//   --led-pixel-mapper="PanelLayout:penn.layout"
+class PanelLayoutMapper : public PixelMapper {
+public:
+  PanelLayoutMapper() : chain_(1), parallel_(1) {}
+
+  virtual const char *GetName() const { return "PanelLayout"; }
+
+  virtual bool SetParameters(int chain, int parallel, const char *param) {
+    if (param == NULL || *param == '\0') {
+      fprintf(stderr, "PanelLayout: need a layout file, e.g. "
+              "PanelLayout:layout.txt\n");
+      return false;
+    }
+    FILE *f = fopen(param, "r");
+    if (f == NULL) {
+      fprintf(stderr, "PanelLayout: can't open %s: %s\n",
+              param, strerror(errno));
+      return false;
+    }
+    std::vector<Panel> panels;
+    char line[256];
+    int line_no = 0;
+    bool success = true;
+    while (success && fgets(line, sizeof(line), f)) {
+      ++line_no;
+      char *comment = strchr(line, '#');
+      if (comment) *comment = '\0';
+      Panel p;
+      p.rotation = 0;
+      char extra;
+      const int fields = sscanf(line, "%d %d %d %d %d %c", &p.chain_pos,
+                                &p.parallel_pos, &p.x, &p.y, &p.rotation,
+                                &extra);
+      if (fields == EOF) continue;   // Empty line or comment.
+      if (fields < 4 || fields > 5) {
+        fprintf(stderr, "PanelLayout: %s:%d: expected "
+                "<chain-position> <parallel-chain> <x> <y> [<rotation>]\n",
+                param, line_no);
+        success = false;
+      } else if (p.chain_pos < 0 || p.chain_pos >= chain
+                 || p.parallel_pos < 0 || p.parallel_pos >= parallel) {
+        fprintf(stderr, "PanelLayout: %s:%d: no panel %d of chain %d "
+                "with --led-chain=%d --led-parallel=%d\n", param, line_no,
+                p.chain_pos, p.parallel_pos, chain, parallel);
+        success = false;
+      } else if (p.x < 0 || p.y < 0) {
+        fprintf(stderr, "PanelLayout: %s:%d: negative position\n",
+                param, line_no);
+        success = false;
+      } else if (p.rotation % 90 != 0 || p.rotation < 0 || p.rotation >= 360) {
+        fprintf(stderr, "PanelLayout: %s:%d: rotation must be 0, 90, 180 "
+                "or 270\n", param, line_no);
+        success = false;
+      }
+      panels.push_back(p);
+    }
+    fclose(f);
+    if (success && panels.empty()) {
+      fprintf(stderr, "PanelLayout: %s: no panels\n", param);
+      success = false;
+    }
+    if (!success) return false;
+    chain_ = chain;
+    parallel_ = parallel;
+    panels_ = panels;
+    return true;
+  }
+
+  virtual bool GetSizeMapping(int matrix_width, int matrix_height,
+                              int *visible_width, int *visible_height)
+    const {
+    const int panel_width = matrix_width / chain_;
+    const int panel_height = matrix_height / parallel_;
+    *visible_width = 0;
+    *visible_height = 0;
+    for (size_t i = 0; i < panels_.size(); ++i) {
+      const Panel &p = panels_[i];
+      const bool turned = (p.rotation == 90 || p.rotation == 270);
+      *visible_width = std::max(*visible_width,
+                                p.x + (turned ? panel_height : panel_width));
+      *visible_height = std::max(*visible_height,
+                                 p.y + (turned ? panel_width : panel_height));
+    }
+    return true;
+  }
+
+  virtual void MapVisibleToMatrix(int matrix_width, int matrix_height,
+                                  int x, int y,
+                                  int *matrix_x, int *matrix_y) const {
+    // Only used while the mapping is baked into the pixel designators, so a
+    // linear search over the panels is fine. Uncovered pixels are mapped
+    // to an invisible position.
+    const int panel_width = matrix_width / chain_;
+    const int panel_height = matrix_height / parallel_;
+    for (size_t i = 0; i < panels_.size(); ++i) {
+      const Panel &p = panels_[i];
+      const bool turned = (p.rotation == 90 || p.rotation == 270);
+      const int lx = x - p.x;
+      const int ly = y - p.y;
+      if (lx < 0 || ly < 0 || lx >= (turned ? panel_height : panel_width)
+          || ly >= (turned ? panel_width : panel_height))
+        continue;
+      int px, py;  // Position within the panel as it is wired.
+      switch (p.rotation) {
+      case 0:   px = lx;                   py = ly; break;
+      case 90:  px = ly;                   py = panel_height - 1 - lx; break;
+      case 180: px = panel_width - 1 - lx; py = panel_height - 1 - ly; break;
+      default:  px = panel_width - 1 - ly; py = lx; break;   // 270
+      }
+      *matrix_x = p.chain_pos * panel_width + px;
+      *matrix_y = p.parallel_pos * panel_height + py;
+      return;
+    }
+    *matrix_x = *matrix_y = -1;
+  }
+
+private:
+  struct Panel {
+    int chain_pos;
+    int parallel_pos;
+    int x, y;
+    int rotation;
+  };
+
+  int chain_;
+  int parallel_;
+  std::vector<Panel> panels_;
+};
+
 typedef std::map<std::string, PixelMapper*> MapperByName;
 static void RegisterPixelMapperInternal(MapperByName *registry,
                                         PixelMapper *mapper) {
@@ -296,6 +437,7 @@ static MapperByName *CreateMapperMap() {
   RegisterPixelMapperInternal(result, new UArrangementMapper());
   RegisterPixelMapperInternal(result, new VerticalMapper());
   RegisterPixelMapperInternal(result, new MirrorPixelMapper());
+  RegisterPixelMapperInternal(result, new PanelLayoutMapper());
   return result;
 }
 
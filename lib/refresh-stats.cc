@@ -0,0 +1,76 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+// Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation version 2.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://gnu.org/licenses/gpl-2.0.txt>
+
+#include "refresh-stats.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+namespace rgb_matrix {
+// shm_open() wants exactly one leading slash.
+static std::string SharedMemoryName(const char *name) {
+  return name[0] == '/' ? name : std::string("/") + name;
+}
+
+/*static*/ RefreshStats *RefreshStats::Create(const char *name) {
+  // Readable for everyone: the watching process typically doesn't run as
+  // root, while we do, at least until privileges are dropped.
+  const int fd = shm_open(SharedMemoryName(name).c_str(), O_RDWR | O_CREAT,
+                          0644);
+  if (fd < 0) return NULL;
+  void *mem = MAP_FAILED;
+  if (ftruncate(fd, sizeof(RefreshStats)) == 0) {
+    mem = mmap(NULL, sizeof(RefreshStats), PROT_READ | PROT_WRITE, MAP_SHARED,
+               fd, 0);
+  }
+  close(fd);
+  if (mem == MAP_FAILED) return NULL;
+
+  RefreshStats *stats = reinterpret_cast<RefreshStats*>(mem);
+  stats->magic = 0;  // Invalid while we reset the previous content.
+  memset(reinterpret_cast<char*>(stats) + sizeof(stats->magic), 0,
+         sizeof(RefreshStats) - sizeof(stats->magic));
+  __atomic_store_n(&stats->magic, kMagic, __ATOMIC_RELEASE);
+  return stats;
+}
+
+/*static*/ const RefreshStats *RefreshStats::Open(const char *name) {
+  const int fd = shm_open(SharedMemoryName(name).c_str(), O_RDONLY, 0);
+  if (fd < 0) return NULL;
+  struct stat st;
+  void *mem = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size == sizeof(RefreshStats)) {
+    mem = mmap(NULL, sizeof(RefreshStats), PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (mem == MAP_FAILED) return NULL;
+
+  const RefreshStats *stats = reinterpret_cast<const RefreshStats*>(mem);
+  if (__atomic_load_n(&stats->magic, __ATOMIC_ACQUIRE) != kMagic) {
+    Close(stats);
+    return NULL;
+  }
+  return stats;
+}
+
+/*static*/ void RefreshStats::Close(const RefreshStats *stats) {
+  if (stats) munmap(const_cast<RefreshStats*>(stats), sizeof(RefreshStats));
+}
+}  // namespace rgb_matrix
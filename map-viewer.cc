@@ -1,40 +1,86 @@
 #include "city.h"
+#include "content-streamer.h"
+#include "csv-reader.h"
+#include "daily-data.h"
 #include "graphics.h"
 #include "led-matrix.h"
 
 #include <Eigen/Dense>
 
-#include <fstream>
+#include <climits>
+#include <fcntl.h>
 #include <getopt.h>
 #include <iostream>
+#include <poll.h>
 #include <signal.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 using namespace std;
 using namespace rgb_matrix;
 
-vector<string> tokenize_csv_line(string line);
+// Everything needed to draw the map; shared by the live and the animated map.
+struct MapView {
+    CityTable all_cities;
+    CityTable ref_cities;
+    CityIndex city_index;  // Refers to all_cities.
+    bool aggregate_max = false;
+    bool show_ref_cities = false;
+    ColorRamp ramp;  // The palette; the range is set per frame.
+    ColorRamp::Scale scale = ColorRamp::SCALE_LOG;
+};
+
 static void interrupt_handler(int signal);
 static void print_usage(const char *prog_name);
-static void transform_coords(vector<City> *all_cities, 
-    vector<City> *ref_cities);
-static void set_pixel_remmaped(RGBMatrix *matrix, int x, int y, uint8_t r, 
-    uint8_t g, uint8_t b);
-static vector<City> load_all_cities();
-static vector<City> load_ref_cities(vector<City> *all_cities, string ref_string);
+static void transform_coords(CityTable *all_cities,
+    const CityTable &ref_cities);
+static void load_all_cities(CityTable *cities, CityIndex *index);
+static void load_ref_cities(const CityTable &all_cities,
+    const CityIndex &index, string ref_string, CityTable *ref_cities);
+static bool open_daily_data(DailyData *daily);
+static int watch_daily_data();
+static bool wait_for_update(int watch_fd, int interval);
+static bool draw_map(Canvas *canvas, const MapView &view);
+static void draw_date(Canvas *canvas, const MapView &view,
+    const DailyData &daily, int date_index, const ColorRamp &ramp);
+static void set_ramp_range(const DailyData &daily, int first_date,
+    int last_date, ColorRamp::Scale scale, ColorRamp *ramp);
+static bool record_animation(RGBMatrix *matrix, const MapView &view,
+    uint32_t hold_time_us, StreamIO *stream);
+static void play_animation(RGBMatrix *matrix, StreamIO *stream);
+static float aggregate_positive(const CityTable &all_cities,
+    const int *cities, int count, const vector<unsigned int> &state_positive,
+    bool use_max);
+
+// Panel layout of the setup at Penn, for the PanelLayout pixel mapper.
+static const char *PENN_LAYOUT_PATH = "penn.layout";
+
+static const uint32_t DATE_SELECTION = 20200814;
+
+// Seconds between re-reads of daily.csv if it cannot be watched.
+static const int DEFAULT_REFRESH_INTERVAL = 10;
+
+// Recorded frames of --animate, one per date.
+static const char *ANIMATION_PATH = "daily.stream";
+static const int DEFAULT_HOLD_MS = 100;
 
 volatile bool interrupt_received = false;
 
 int main(int argc, char *argv[])  {
 
-    RGBMatrix *matrix = CreateMatrixFromFlags(&argc, &argv);
+    RGBMatrix::Options matrix_options;
+    RGBMatrix *matrix = CreateMatrixFromFlags(&argc, &argv, &matrix_options);
     if (matrix == NULL)
         return 1;
 
     string ref_cities_string = 
         "Olympia,WA,19,4,Augusta,ME,109,10,Austin,TX,60,51";
-    bool show_ref_cities = false;
-    bool use_remapper = false;
+    MapView view;
+    int refresh_interval = 0;
+    bool animate = false;
+    int hold_ms = DEFAULT_HOLD_MS;
 
     // Parse command-line options.
     while (true) {
@@ -42,10 +88,17 @@ int main(int argc, char *argv[])  {
             {"ref-string", required_argument, 0, 'r'},
             {"show-ref", no_argument, 0, 's'},
             {"use-remapper", no_argument, 0, 'm'},
+            {"aggregate", required_argument, 0, 'a'},
+            {"interval", required_argument, 0, 'i'},
+            {"animate", no_argument, 0, 'A'},
+            {"hold", required_argument, 0, 'H'},
+            {"palette", required_argument, 0, 'p'},
+            {"scale", required_argument, 0, 'S'},
             {0, 0, 0, 0}
         };
         int option_index = 0;
-        int opt = getopt_long(argc, argv, "r:sm", long_options, &option_index);
+        int opt = getopt_long(argc, argv, "r:sma:i:AH:p:S:", long_options,
+            &option_index);
         if (opt == -1)
             break;
         switch (opt) {
@@ -53,10 +106,59 @@ int main(int argc, char *argv[])  {
                 ref_cities_string = optarg;
                 break;
             case 's':
-                show_ref_cities = true;
+                view.show_ref_cities = true;
                 break;
             case 'm':
-                use_remapper = true;
+                // Same as --led-pixel-mapper="PanelLayout:penn.layout".
+                if (!matrix->ApplyPixelMapper(FindPixelMapper("PanelLayout",
+                        matrix_options.chain_length, matrix_options.parallel,
+                        PENN_LAYOUT_PATH)))
+                    return 1;
+                break;
+            case 'a':
+                if (string(optarg) == "max") {
+                    view.aggregate_max = true;
+                } else if (string(optarg) == "mean") {
+                    view.aggregate_max = false;
+                } else {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'i':
+                refresh_interval = atoi(optarg);
+                if (refresh_interval <= 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'A':
+                animate = true;
+                break;
+            case 'H':
+                hold_ms = atoi(optarg);
+                if (hold_ms <= 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'p':
+                if (!view.ramp.ParseGradient(optarg)) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'S':
+                if (string(optarg) == "log") {
+                    view.scale = ColorRamp::SCALE_LOG;
+                } else if (string(optarg) == "linear") {
+                    view.scale = ColorRamp::SCALE_LINEAR;
+                } else if (string(optarg) == "quantile") {
+                    view.scale = ColorRamp::SCALE_QUANTILE;
+                } else {
+                    print_usage(argv[0]);
+                    return 1;
+                }
                 break;
             case '?':
                 print_usage(argv[0]);
@@ -66,246 +168,418 @@ int main(int argc, char *argv[])  {
             }
     }
 
-    vector<City> all_cities = load_all_cities();
-    vector<City> ref_cities = load_ref_cities(&all_cities, ref_cities_string);
-    transform_coords(&all_cities, &ref_cities);
+    load_all_cities(&view.all_cities, &view.city_index);
+    load_ref_cities(view.all_cities, view.city_index, ref_cities_string,
+        &view.ref_cities);
+    if (view.ref_cities.size() < 3) {
+        cerr << "Need at least three reference cities." << endl;
+        return 1;
+    }
+    transform_coords(&view.all_cities, view.ref_cities);
+    view.city_index.BuildPixelIndex(view.all_cities, matrix->width(),
+        matrix->height());
 
-    string line;
-    ifstream line_stream("daily.csv");
-    if (!line_stream.is_open()) {
-        cerr << "Error opening states CSV." << endl;
+    signal(SIGINT, interrupt_handler);
+    signal(SIGTERM, interrupt_handler);
+
+    if (animate) {
+        // Color every date once, then only copy the recorded frames.
+        int fd = open(ANIMATION_PATH, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            perror(ANIMATION_PATH);
+            return 1;
+        }
+        FileStreamIO stream(fd);
+        if (!record_animation(matrix, view, hold_ms * 1000, &stream))
+            return 1;
+        cout << "Done. Press Ctrl+C to exit." << endl;
+        play_animation(matrix, &stream);
+        cout << endl;
+        matrix->Clear();
+        delete matrix;
+        return 0;
+    }
+
+    // Draw into an offscreen canvas and swap it in on vertical sync, so the
+    // panels never show a half-drawn map. Parsing and drawing happen on this
+    // thread; the matrix refresh thread only ever sees complete frames.
+    FrameCanvas *offscreen = matrix->CreateFrameCanvas();
+    if (!draw_map(offscreen, view))
         return 1;
+    // The map stays up until the data changes, so the refresh thread can
+    // show it from precomputed output.
+    offscreen->Compile();
+    offscreen = matrix->SwapOnVSync(offscreen);
+
+    // Without an interval, redraw whenever daily.csv is rewritten. Fall back
+    // to polling every few seconds if the file cannot be watched.
+    int watch_fd = -1;
+    if (refresh_interval == 0) {
+        watch_fd = watch_daily_data();
+        if (watch_fd < 0) {
+            cerr << "Cannot watch daily.csv, re-reading it every "
+                << DEFAULT_REFRESH_INTERVAL << " seconds." << endl;
+            refresh_interval = DEFAULT_REFRESH_INTERVAL;
+        }
     }
 
-    const string DATE_SELECTION = "20200814";
-    map<string, unsigned int> statePositive;
-    unsigned int positive_min = LONG_MAX;
-    unsigned int positive_max = 0;
+    cout << "Done. Press Ctrl+C to exit." << endl;
+    while (wait_for_update(watch_fd, refresh_interval)) {
+        // Keep showing the previous map if the new data cannot be read.
+        if (draw_map(offscreen, view)) {
+            offscreen->Compile();
+            offscreen = matrix->SwapOnVSync(offscreen);
+        }
+    }
+    cout << endl;
 
-    getline(line_stream, line); // Skip the first line with column names.
+    if (watch_fd >= 0)
+        close(watch_fd);
+    matrix->Clear();
+    delete matrix;
+}
 
-    while (getline(line_stream, line)) {
-        vector<string> tokens = tokenize_csv_line(line);
-        
-        // Skip if no match.
-        string date = tokens[0];
-        if (DATE_SELECTION.compare(date))
-            continue;
-        
-        string name = tokens[1];
-        unsigned int positive = stol(tokens[2]);
-        
-        statePositive[name] = positive;
-
-        positive_min = min(positive_min, positive);
-        positive_max = max(positive_max, positive);
+// Draw the map for DATE_SELECTION onto "canvas", replacing its contents.
+// daily.bin is regenerated first if daily.csv changed. Returns false if the
+// data cannot be read.
+static bool draw_map(Canvas *canvas, const MapView &view) {
+    DailyData daily;
+    if (!open_daily_data(&daily)) {
+        cerr << "Error opening states data." << endl;
+        return false;
     }
 
-    for(const auto& city: all_cities) {
-
-        const Color COLOR_MIN = COLOR_YELLOW;
-        const Color COLOR_MAX = COLOR_RED;
-
-        long int positive = statePositive[city.state];
-        
-        // Map from logarithmic (positive_min..positive_max) range to
-        // (0..1) linear range.
-        float log_min = positive_min + 1; //  Avoid division by zero.
-        float log_max = positive_max + 1; //  Avoid division by zero.
-        float percent = (log(positive) - log(log_min))/(log(log_max) - log(log_min));
-
-        // Map from (0..1) range to (COLOR_MIN.r..COLOR_MAX.r) range.
-        int r = (COLOR_MIN.r < COLOR_MAX.r) ? 
-            COLOR_MIN.r + abs(COLOR_MAX.r - COLOR_MIN.r) * percent : 
-            COLOR_MIN.r - abs(COLOR_MAX.r - COLOR_MIN.r) * percent;
-
-        // Map from (0..1) range to (COLOR_MIN.g..COLOR_MAX.g) range.
-        int g = (COLOR_MIN.g < COLOR_MAX.g) ? 
-            COLOR_MIN.g + abs(COLOR_MAX.g - COLOR_MIN.g) * percent : 
-            COLOR_MIN.g - abs(COLOR_MAX.g - COLOR_MIN.g) * percent;
-
-        // Map from (0..1) range to (COLOR_MIN.b..COLOR_MAX.b) range.
-        int b = (COLOR_MIN.b < COLOR_MAX.b) ? 
-            COLOR_MIN.b + abs(COLOR_MAX.b - COLOR_MIN.b) * percent : 
-            COLOR_MIN.b - abs(COLOR_MAX.b - COLOR_MIN.b) * percent;
-
-        if (use_remapper)
-            set_pixel_remmaped(matrix, city.x, city.y, r, g, b);
-        else
-            matrix->SetPixel(city.x, city.y, r, g, b);
+    int date_index = daily.FindDate(DATE_SELECTION);
+    if (date_index < 0) {
+        cerr << "No data for " << DATE_SELECTION << "." << endl;
+        return false;
     }
+    ColorRamp ramp = view.ramp;
+    set_ramp_range(daily, date_index, date_index, view.scale, &ramp);
+    draw_date(canvas, view, daily, date_index, ramp);
+    return true;
+}
 
-    // Display reference cities in a different color.
-    if (show_ref_cities) {
-        for(const auto& city: ref_cities) {
-            if (use_remapper)
-                set_pixel_remmaped(matrix, city.x, city.y, COLOR_WHITE.r, COLOR_WHITE.g, COLOR_WHITE.b);
-            else
-                matrix->SetPixel(city.x, city.y, COLOR_WHITE.r, COLOR_WHITE.g, COLOR_WHITE.b);
+// Spread "ramp" over the positive cases of the dates first_date..last_date.
+static void set_ramp_range(const DailyData &daily, int first_date,
+    int last_date, ColorRamp::Scale scale, ColorRamp *ramp) {
+    vector<float> samples;
+    unsigned int positive_min = UINT_MAX;
+    unsigned int positive_max = 0;
+    for (int d = first_date; d <= last_date; d++) {
+        const int32_t *positives = daily.values(DAILY_POSITIVE, d);
+        for (int i = 0; i < daily.row_count(d); i++) {
+            unsigned int positive = positives[i];
+            positive_min = min(positive_min, positive);
+            positive_max = max(positive_max, positive);
+            if (scale == ColorRamp::SCALE_QUANTILE)
+                samples.push_back(positive);
         }
     }
+    if (scale == ColorRamp::SCALE_QUANTILE)
+        ramp->SetQuantiles(samples.data(), samples.size());
+    else
+        ramp->SetRange(positive_min, positive_max, scale);
+}
 
-    signal(SIGINT, interrupt_handler);
-    cout << "Done. Press Ctrl+C to exit." << endl;
-    do {
-        // TODO Update here.
-        sleep(1); // Avoid flickering.
-    } while (!interrupt_received);
-    cout << endl;
+// Draw the map of the given date onto "canvas", replacing its contents.
+static void draw_date(Canvas *canvas, const MapView &view,
+    const DailyData &daily, int date_index, const ColorRamp &ramp) {
+    const CityTable &all_cities = view.all_cities;
+    const CityIndex &city_index = view.city_index;
+
+    // Indexed by the state ids of all_cities.
+    vector<unsigned int> statePositive(all_cities.state_count(), 0);
+    const uint8_t *state_ids = daily.state_ids(date_index);
+    const int32_t *positives = daily.values(DAILY_POSITIVE, date_index);
+    for (int i = 0; i < daily.row_count(date_index); i++) {
+        int state_id = all_cities.StateId(daily.state_code(state_ids[i]));
+        if (state_id >= 0)
+            statePositive[state_id] = positives[i];
+    }
 
-    matrix->Clear();
+    canvas->Clear();
+
+    // Many cities land on the same LED. Combine their values first so that
+    // every lit LED is drawn exactly once, independent of the city order.
+    // The LEDs are then set in one batch, mapping each ramp color only once.
+    vector<Point> points;
+    vector<Color> colors;
+    for (int y = 0; y < city_index.height(); y++) {
+        for (int x = 0; x < city_index.width(); x++) {
+            int count;
+            const int *cities = city_index.AtPixel(x, y, &count);
+            if (count == 0)
+                continue;
+
+            float positive = aggregate_positive(all_cities, cities, count,
+                statePositive, view.aggregate_max);
+            points.push_back(Point(x, y));
+            colors.push_back(ramp.Map(positive));
+        }
+    }
+    canvas->SetPixels(points.data(), colors.data(), points.size());
+
+    // Display reference cities in a different color.
+    if (view.show_ref_cities) {
+        points.clear();
+        for (size_t i = 0; i < view.ref_cities.size(); i++)
+            points.push_back(Point(view.ref_cities.x(i), view.ref_cities.y(i)));
+        canvas->FillPixels(points.data(), points.size(), COLOR_WHITE);
+    }
+}
+
+// Render every date of the daily data into "stream", each to be shown for
+// "hold_time_us". All frames share one color scale so that the growth over
+// time is visible.
+static bool record_animation(RGBMatrix *matrix, const MapView &view,
+    uint32_t hold_time_us, StreamIO *stream) {
+    DailyData daily;
+    if (!open_daily_data(&daily) || daily.date_count() == 0) {
+        cerr << "Error opening states data." << endl;
+        return false;
+    }
+    ColorRamp ramp = view.ramp;
+    set_ramp_range(daily, 0, daily.date_count() - 1, view.scale, &ramp);
+
+    FrameCanvas *frame = matrix->CreateFrameCanvas();
+    StreamWriter writer(stream);
+    for (int d = 0; d < daily.date_count() && !interrupt_received; d++) {
+        draw_date(frame, view, daily, d, ramp);
+        if (!writer.Stream(*frame, hold_time_us)) {
+            cerr << "Error writing " << ANIMATION_PATH << "." << endl;
+            return false;
+        }
+    }
+    return true;
 }
 
-vector<string> tokenize_csv_line(string line) {
-    vector<string> tokens;
-    stringstream line_stream(line);
-    string token;
-    while (getline(line_stream, token, ',')) {
-        
-        // Remove any surrounding quotation marks.
-        token.erase(remove(token.begin(), token.end(), '\"'), token.end());
-        
-        tokens.push_back(token);
+// Play the recorded frames in a loop until interrupted. Every frame is
+// copied into the offscreen canvas and swapped in on vertical sync.
+static void play_animation(RGBMatrix *matrix, StreamIO *stream) {
+    FrameCanvas *offscreen = matrix->CreateFrameCanvas();
+    StreamReader reader(stream);
+    uint32_t hold_time_us;
+    while (!interrupt_received) {
+        if (!reader.GetNext(offscreen, &hold_time_us)) {
+            reader.Rewind();
+            if (!reader.GetNext(offscreen, &hold_time_us))
+                return;  // Empty or broken stream.
+        }
+        offscreen = matrix->SwapOnVSync(offscreen);
+        usleep(hold_time_us);
     }
-    return tokens;
+}
+
+// Combine the positive cases of the states of the given cities, either as the
+// maximum or as the mean weighted by city population.
+static float aggregate_positive(const CityTable &all_cities,
+    const int *cities, int count, const vector<unsigned int> &state_positive,
+    bool use_max) {
+    float max_positive = 0;
+    double weighted_sum = 0;
+    double total_weight = 0;
+    for (int i = 0; i < count; i++) {
+        const int city = cities[i];
+        float positive = state_positive[all_cities.state_id(city)];
+        double weight = max(all_cities.population(city), 1);  // Unknown population.
+        max_positive = max(max_positive, positive);
+        weighted_sum += weight * positive;
+        total_weight += weight;
+    }
+    return use_max ? max_positive : weighted_sum / total_weight;
 }
 
 static void print_usage(const char *prog_name) {
     cerr <<
     "Usage: sudo ./map-viewer [options]\n\nOptions:\n\t--ref-string, -r : Comma"
     "-separated reference string with format, \"<city1>,<st1>,<x1>,<y1>,<city2>"
-    ",<st2>,<x2>,<y2>,<city3>,<st3>,<x3>,<y3>\" (default=\"Olympia,WA,19,4,Augu"
-    "sta,ME,109,10,Austin,TX,60,51\")\n\t--led-cols       : Number of columns i"
+    ",<st2>,<x2>,<y2>,<city3>,<st3>,<x3>,<y3>[,...]\"; more than three cities ar"
+    "e fitted by least squares (default=\"Olympia,WA,19,4,Augusta,ME,109,10,Aus"
+    "tin,TX,60,51\")\n\t--aggregate, -a  : How cities on the s"
+    "ame LED are combined, \"max\" or \"mean\" (population-weighted, default=\"m"
+    "ean\").\n\t--interval, -i   : Re-read daily.csv every <n> seconds ins"
+    "tead of redrawing when it changes.\n\t--hold, -H       : Milliseconds"
+    " each date is shown with --animate (default=100).\n\t--palette, -p    :"
+    " Comma-separated gradient of color names (e.g. \"deep-orange\") or hex"
+    " colors \"rrggbb\" (default=\"yellow,red\").\n\t--scale, -S      : How "
+    "cases map onto the palette, \"log\", \"linear\" or \"quantile\" (defa"
+    "ult=\"log\").\n\t--led-cols       : Number of columns i"
     "n one panel (default=32).\n\t--led-rows       : Number of rows in one pane"
     "l (default=32).\n\t--led-chain      : Number of daisy-chained panels (defa"
     "ult=1).\n\t--led-parallel   : Number of parallel chains (range=1..3, defau"
     "lt=1).\n\nFlags:\n\t--show-ref, -s     : Show reference cities in white.\n"
-    "\t--use-remapper, -m : Use the remapper for the setup at Penn."
+    "\t--use-remapper, -m : Use the panel layout of the setup at Penn (penn.l"
+    "ayout).\n\t--anim"
+    "ate, -A      : Show all dates as a time-lapse instead of a single date."
     << endl;
 }
 
-void transform_coords(vector<City> *all_cities, vector<City> *ref_cities) {
-
-    // Find the transformation required to get reference cities' coordinates
-    // from (<lng>, <lng>) to (<x>, <y>).
-    Eigen::MatrixXf A(6, 6);
-    A << 
-        (*ref_cities)[0].lng, (*ref_cities)[0].lat, 1, 0, 0, 0,
-        0, 0, 0, (*ref_cities)[0].lng, (*ref_cities)[0].lat, 1,
-        (*ref_cities)[1].lng, (*ref_cities)[1].lat, 1, 0, 0, 0,
-        0, 0, 0, (*ref_cities)[1].lng, (*ref_cities)[1].lat, 1,
-        (*ref_cities)[2].lng, (*ref_cities)[2].lat, 1, 0, 0, 0,
-        0, 0, 0, (*ref_cities)[2].lng, (*ref_cities)[2].lat, 1;
-    Eigen::MatrixXf A_prime(6, 1);
-    A_prime << (*ref_cities)[0].x, (*ref_cities)[0].y,
-               (*ref_cities)[1].x, (*ref_cities)[1].y,
-               (*ref_cities)[2].x, (*ref_cities)[2].y;
-    Eigen::MatrixXf trans = A.inverse() * A_prime;
-
-    vector<City>::iterator it;
-    for(it = all_cities->begin(); it != all_cities->end(); it++) {
-
-        // Transform spherical coordinates into planar coordinates. The plate 
-        // carrée projection simply maps x to be the value of the longitude 
-        // and y to be the value of the latitude.
-        float planar_x = (*it).lng;
-        float planar_y = (*it).lat;
-        
-        // Transform planar coordinates into matrix coordinates.
-        Eigen::MatrixXf B(2, 6);
-        B <<
-            planar_x, planar_y, 1, 0, 0, 0,
-            0, 0, 0, planar_x, planar_y, 1;
-        Eigen::MatrixXf B_prime = B * trans;
-        (*it).x = int(B_prime(0, 0));
-        (*it).y = int(B_prime(1, 0));
+void transform_coords(CityTable *all_cities, const CityTable &ref_cities) {
+
+    // Find the affine transformation that takes the reference cities from
+    // (<lng>, <lat>) to (<x>, <y>). Three cities determine it exactly; with
+    // more, this is the least-squares fit, solved through the 3x3 normal
+    // equations. Double precision as the coordinates are far from the origin.
+    const int n_ref = ref_cities.size();
+    Eigen::MatrixX3d A(n_ref, 3);
+    Eigen::MatrixX2d A_prime(n_ref, 2);
+    for (int i = 0; i < n_ref; i++) {
+        A.row(i) << ref_cities.lng(i), ref_cities.lat(i), 1;
+        A_prime.row(i) << ref_cities.x(i), ref_cities.y(i);
     }
-
+    const Eigen::Matrix3d AtA = A.transpose() * A;
+    const Eigen::Matrix<double, 3, 2> AtA_prime = A.transpose() * A_prime;
+    const Eigen::Matrix<float, 2, 3> trans =
+        AtA.ldlt().solve(AtA_prime).transpose().cast<float>();
+
+    // Transform spherical coordinates into planar coordinates. The plate 
+    // carrée projection simply maps x to be the value of the longitude 
+    // and y to be the value of the latitude.
+    // The table already stores the longitudes and latitudes contiguously.
+    const int n = all_cities->size();
+    Eigen::Map<const Eigen::ArrayXf> planar_x(all_cities->lngs(), n);
+    Eigen::Map<const Eigen::ArrayXf> planar_y(all_cities->lats(), n);
+
+    // Transform planar coordinates into matrix coordinates, all cities at
+    // once so that Eigen can vectorize. Cities far off the matrix are
+    // clamped to the int16 range of the table.
+    typedef Eigen::Array<int16_t, Eigen::Dynamic, 1> ArrayXs;
+    const float LIMIT = INT16_MAX;
+    Eigen::Map<ArrayXs>(all_cities->xs(), n) =
+        (trans(0, 0) * planar_x + trans(0, 1) * planar_y + trans(0, 2))
+        .max(-LIMIT).min(LIMIT).cast<int16_t>();
+    Eigen::Map<ArrayXs>(all_cities->ys(), n) =
+        (trans(1, 0) * planar_x + trans(1, 1) * planar_y + trans(1, 2))
+        .max(-LIMIT).min(LIMIT).cast<int16_t>();
 }
 
-vector<City> load_all_cities() {
-    vector<City> cities;
-    string line;
-    ifstream line_stream("uscities.csv");
-    if (!line_stream.is_open()) {
+void load_all_cities(CityTable *cities, CityIndex *index) {
+    cities->Clear();
+    CSVReader csv;
+    if (!csv.Open("uscities.csv")) {
         cerr << "Error opening cities CSV." << endl;
+        return;
     }
 
     // Skip the first line with column names.
-    getline(line_stream, line);
-
-    // For each record, create a new city and insert.
-    while (getline(line_stream, line)) {
-    
-        vector<string> tokens = tokenize_csv_line(line);
-        string name = tokens[0];
-        string state = tokens[2];
-        float lng = atof(tokens[9].c_str());
-        float lat = atof(tokens[8].c_str());
-
-        City new_city(name, state, lng, lat);
-        cities.push_back(new_city);
+    csv.NextRecord();
+
+    // For each record, append a new city; the fields are copied straight
+    // from the reader's buffer into the table.
+    cities->Reserve(32 * 1024);
+    while (csv.NextRecord()) {
+        if (csv.field_count() < 11)
+            continue;
+        float lng = atof(csv.field(9).data());
+        float lat = atof(csv.field(8).data());
+        int population = atoi(csv.field(10).data());
+        cities->Add(csv.field(0), csv.field(2), lng, lat, population);
     }
-    return cities;
+    index->BuildNameIndex(*cities);
 }
 
-vector<City> load_ref_cities(vector<City> *all_cities, string ref_string) {
-    vector<City> ref_cities;
-    const int N_REF_CITIES = 3;
+void load_ref_cities(const CityTable &all_cities, const CityIndex &index,
+    string ref_string, CityTable *ref_cities) {
+    ref_cities->Clear();
+    const int FIELDS_PER_CITY = 4;
 
-    vector<string> tokens = tokenize_csv_line(ref_string);
+    vector<string_view> tokens;
+    SplitCSVRecord(&ref_string[0], &ref_string[0] + ref_string.size(), &tokens);
+    const int n_ref_cities = tokens.size() / FIELDS_PER_CITY;
 
-    for (int i = 0; i < N_REF_CITIES; i++) {
-        int idx = i * (N_REF_CITIES + 1);
+    for (int i = 0; i < n_ref_cities; i++) {
+        int idx = i * FIELDS_PER_CITY;
 
         // ref_string should follow the format, "<name1>,<state1>,<x1>,<y1>,..."
-        string name = tokens[idx];
-        string state = tokens[idx + 1];
-        int x = atoi(tokens[idx + 2].c_str());
-        int y = atoi(tokens[idx + 3].c_str());
-
-        vector<City>::iterator it;
-        for(it = all_cities->begin(); it != all_cities->end(); it++) {
-            
-            // Skip if no match.
-            if ((*it).name.compare(name) || (*it).state.compare(state))
-                continue;
-            
-            City new_city((*it).name, (*it).state, (*it).lng, (*it).lat, x, y);
-            ref_cities.push_back(new_city);
+        string_view name = tokens[idx];
+        string_view state = tokens[idx + 1];
+        int x = atoi(tokens[idx + 2].data());
+        int y = atoi(tokens[idx + 3].data());
+
+        int found = index.Find(state, name);
+        if (found < 0) {
+            cerr << "Reference city " << name << ", " << state
+                << " not found." << endl;
+            continue;
         }
+
+        int ref = ref_cities->Add(all_cities.name(found),
+            all_cities.state(found), all_cities.lng(found),
+            all_cities.lat(found));
+        ref_cities->set_xy(ref, x, y);
     }
+}
 
-    return ref_cities;
+// Open the binary version of daily.csv, (re)creating it first if it is
+// missing or older than the CSV.
+static bool open_daily_data(DailyData *daily) {
+    const char *CSV_PATH = "daily.csv";
+    const char *BIN_PATH = "daily.bin";
+
+    struct stat csv_stat, bin_stat;
+    bool have_csv = stat(CSV_PATH, &csv_stat) == 0;
+    bool have_bin = stat(BIN_PATH, &bin_stat) == 0;
+    // Compare with nanoseconds; a refresh can rewrite the CSV within the
+    // second that daily.bin was created.
+    if (have_csv && (!have_bin
+            || bin_stat.st_mtim.tv_sec < csv_stat.st_mtim.tv_sec
+            || (bin_stat.st_mtim.tv_sec == csv_stat.st_mtim.tv_sec
+                && bin_stat.st_mtim.tv_nsec < csv_stat.st_mtim.tv_nsec))) {
+        if (!ConvertDailyCSV(CSV_PATH, BIN_PATH))
+            return false;
+    }
+    return daily->Open(BIN_PATH);
 }
 
-static void interrupt_handler(int signal) {
-    interrupt_received = true;
+// Watch the current directory for daily.csv being rewritten or replaced.
+// Returns an inotify descriptor, or -1 on failure.
+static int watch_daily_data() {
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (inotify_add_watch(fd, ".", IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
 }
 
-// This function is temporary and should only be used for the Penn set up. This 
-// is not how pixels should be remapped; implement the PixelMapper interface 
-// instead. Remapping tests:
-//  (132, 34) -> (93, 36)
-//  (34, 36) -> (164, 61)
-//  (166, 105) -> (22, 70)
-//  (7, 1) -> (129, 88)
-//  (125, 83) -> (44, 29)
-static void set_pixel_remmaped(RGBMatrix *matrix, int x, int y, uint8_t r, 
-    uint8_t g, uint8_t b) {
-
-    // Skip if pixel if pixel is not visible.
-    if (x < 0 || x >= 192 || y < 0 || y >= 128)
-        return;
+// Wait until daily.csv changed (if "watch_fd" is valid) or "interval"
+// seconds passed (if > 0). Wakes up every second to check for an interrupt;
+// returns false once one was received.
+static bool wait_for_update(int watch_fd, int interval) {
+    for (int waited = 0; !interrupt_received; waited++) {
+        if (interval > 0 && waited >= interval)
+            return true;
+        if (watch_fd < 0) {
+            sleep(1);
+            continue;
+        }
+        struct pollfd pfd = { watch_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 1000) <= 0)
+            continue;
 
-    int new_x, new_y;
-    if (x < 96) {
-        new_x = y +  128;
-        new_y = 95 - x;
-    } else {
-        new_x = 127 - y;
-        new_y = x - 96;
+        // Other files in the directory, including daily.bin, are ignored.
+        bool changed = false;
+        char events[4096]
+            __attribute__ ((aligned(__alignof__(struct inotify_event))));
+        ssize_t len;
+        while ((len = read(watch_fd, events, sizeof(events))) > 0) {
+            for (char *p = events; p < events + len; ) {
+                const struct inotify_event *event =
+                    (const struct inotify_event *) p;
+                if (event->len > 0 && strcmp(event->name, "daily.csv") == 0)
+                    changed = true;
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+        if (changed)
+            return true;
     }
+    return false;
+}
 
-    matrix->SetPixel(new_x, new_y, r, g, b);
-}
\ No newline at end of file
+static void interrupt_handler(int signal) {
+    interrupt_received = true;
+}
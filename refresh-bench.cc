@@ -0,0 +1,180 @@
+#include "gpio.h"
+#include "led-matrix.h"
+
+#include <chrono>
+#include <getopt.h>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+using namespace rgb_matrix;
+
+// Runs the refresh thread of the library against SimulatedGPIO, so the
+// refresh path can be measured on any Linux machine. Output-enable pulses
+// take no time in the simulation; the numbers show the CPU cost of a frame.
+
+static void print_usage(const char *prog_name) {
+    cerr <<
+    "Usage: " << prog_name << " [options]\n\nOptions:\n\t--seconds, -t : Ho"
+    "w long to measure (default=3).\n\t--compile, -c : Show the frame with F"
+    "rameCanvas::Compile().\n\nThe --led-* flags set up the simulated matrix"
+    ", e.g. --led-chain=8 --led-parallel=3.\n";
+    PrintMatrixFlags(stderr);
+}
+
+// Draw a pattern that uses all color bits.
+static void draw_test_pattern(Canvas *canvas) {
+    for (int y = 0; y < canvas->height(); y++) {
+        for (int x = 0; x < canvas->width(); x++) {
+            canvas->SetPixel(x, y, 255 * x / canvas->width(),
+                255 * y / canvas->height(), (x * y) & 0xff);
+        }
+    }
+}
+
+// Counts the CPU cycles of this process in user space, including threads
+// started later, such as the refresh thread. Returns -1 if there is no cycle
+// counter, e.g. in a VM or if /proc/sys/kernel/perf_event_paranoid is > 2.
+static int open_cycle_counter() {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t read_cycles(int fd) {
+    uint64_t cycles = 0;
+    if (fd < 0 || read(fd, &cycles, sizeof(cycles)) != sizeof(cycles))
+        return 0;
+    return cycles;
+}
+
+// FNV-1a over the recorded writes, to compare the output of two versions.
+static uint64_t checksum(const vector<SimulatedGPIO::Write> &writes) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < writes.size(); i++) {
+        const uint32_t words[3] = { uint32_t(writes[i].op), writes[i].value,
+            writes[i].mask };
+        for (int w = 0; w < 3; w++) {
+            for (int b = 0; b < 32; b += 8) {
+                hash ^= (words[w] >> b) & 0xff;
+                hash *= 1099511628211ULL;
+            }
+        }
+    }
+    return hash;
+}
+
+int main(int argc, char *argv[]) {
+    RGBMatrix::Options matrix_options;
+    RuntimeOptions runtime_options;
+    if (!ParseOptionsFromFlags(&argc, &argv, &matrix_options,
+            &runtime_options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    int seconds = 3;
+    bool compile = false;
+    while (true) {
+        static struct option long_options[] = {
+            {"seconds", required_argument, 0, 't'},
+            {"compile", no_argument, 0, 'c'},
+            {0, 0, 0, 0}
+        };
+        int opt = getopt_long(argc, argv, "t:c", long_options, NULL);
+        if (opt == -1)
+            break;
+        switch (opt) {
+            case 't':
+                seconds = atoi(optarg);
+                if (seconds <= 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'c':
+                compile = true;
+                break;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    string error;
+    if (!matrix_options.Validate(&error)) {
+        cerr << error << endl;
+        return 1;
+    }
+
+    // Before the refresh thread starts, so that it counts its cycles.
+    const int cycle_counter = open_cycle_counter();
+
+    SimulatedGPIO simulation;
+    GPIO io;
+    io.InitSimulated(&simulation);
+    RGBMatrix *matrix = new RGBMatrix(&io, matrix_options);
+
+    FrameCanvas *frame = matrix->CreateFrameCanvas();
+    draw_test_pattern(frame);
+    if (compile && !frame->Compile()) {
+        cerr << "Can't compile the frame." << endl;
+        return 1;
+    }
+    matrix->SwapOnVSync(frame);
+
+    const uint64_t frames_before = simulation.frame_count();
+    const uint64_t writes_before = simulation.write_count();
+    const uint64_t pulses_before = simulation.pulse_count();
+    const uint64_t pulse_nanos_before = simulation.pulse_nanos();
+    const uint64_t cycles_before = read_cycles(cycle_counter);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    this_thread::sleep_for(chrono::seconds(seconds));
+    const double elapsed = chrono::duration<double>(
+        chrono::steady_clock::now() - start).count();
+    const double frames = simulation.frame_count() - frames_before;
+    const uint64_t cycles = read_cycles(cycle_counter) - cycles_before;
+    const double writes = (simulation.write_count() - writes_before) / frames;
+    if (frames == 0) {
+        cerr << "No frame was refreshed." << endl;
+        return 1;
+    }
+
+    const double frame_us = 1e6 * elapsed / frames;
+    const double pulse_us =
+        (simulation.pulse_nanos() - pulse_nanos_before) / frames / 1000;
+    cout << matrix->width() << "x" << matrix->height() << ", "
+        << matrix_options.pwm_bits << " PWM bits"
+        << (compile ? ", compiled" : "") << endl;
+    cout << "Refresh: " << frames / elapsed << " Hz (" << frame_us
+        << " us per frame without output-enable time)" << endl;
+    cout << "Per frame: " << writes << " GPIO writes, "
+        << (simulation.pulse_count() - pulses_before) / frames << " pulses of together " << pulse_us << " us" << endl;
+    if (cycle_counter >= 0) {
+        const double frame_cycles = cycles / frames;
+        cout << "CPU cycles per frame: " << frame_cycles << " ("
+            << frame_cycles / writes << " per GPIO write)" << endl;
+    } else {
+        cout << "CPU cycles per frame: no cycle counter" << endl;
+    }
+
+    // One complete frame, to compare the output of different versions.
+    simulation.StartRecording(1);
+    while (!simulation.recording_done())
+        this_thread::sleep_for(chrono::milliseconds(1));
+    cout << "Frame checksum: " << hex << checksum(simulation.recording())
+        << dec << " (" << simulation.recording().size() << " operations)" << endl;
+
+    delete matrix;
+    return 0;
+}
@@ -0,0 +1,223 @@
+#include "refresh-stats.h"
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+using namespace rgb_matrix;
+
+// Watches the refresh statistics that a program running the matrix with
+// --led-refresh-stats=<name> keeps in shared memory. Only reads them, so it
+// does not disturb the refresh thread.
+
+static void print_usage(const char *prog_name) {
+    cerr <<
+    "Usage: " << prog_name << " [options] <name>\n\nShows the refresh statis"
+    "tics of a matrix started with --led-refresh-stats=<name>.\n\nOptions:\n"
+    "\t--interval, -i : Seconds between lines (default=1).\n"
+    "\t--overshoot, -o : Print the histogram of the output-enable pulse\n"
+    "\t                  overshoot and exit.\n"
+    "\t--sleep, -s : Print how long the waits of the timer based pulser\n"
+    "\t              took compared to the request and exit.\n";
+}
+
+// Copy of the counters, to compute what happened between two snapshots.
+struct Snapshot {
+    uint32_t frame_count;
+    uint32_t missed_swaps;
+    uint32_t frame_histogram[RefreshStats::kFrameBuckets];
+};
+
+static Snapshot take_snapshot(const RefreshStats *stats) {
+    Snapshot s;
+    s.frame_count = stats->frame_count.load(memory_order_relaxed);
+    s.missed_swaps = stats->missed_swaps.load(memory_order_relaxed);
+    for (int i = 0; i < RefreshStats::kFrameBuckets; i++)
+        s.frame_histogram[i] = stats->frame_histogram[i].load(
+            memory_order_relaxed);
+    return s;
+}
+
+// Frame time that "fraction" of the frames counted in "histogram" did not
+// exceed, rounded up to the end of its bucket.
+static uint32_t percentile_us(const uint32_t *histogram, uint32_t total,
+        double fraction) {
+    uint32_t count = 0;
+    for (int b = 0; b < RefreshStats::kFrameBuckets; b++) {
+        count += histogram[b];
+        if (count >= fraction * total) {
+            if (b == RefreshStats::kFrameBuckets - 1)
+                return RefreshStats::BucketStart(b);
+            return RefreshStats::BucketStart(b + 1) - 1;
+        }
+    }
+    return 0;
+}
+
+static void print_overshoot_histogram(const RefreshStats *stats) {
+    printf("Overshoot histogram beyond the nanosleep() jitter allowance\n"
+        "%6s | %7s | %7s\n", "usec", "count", "accum");
+    uint64_t total_count = 0;
+    uint32_t counts[RefreshStats::kOvershootBuckets];
+    for (int i = 0; i < RefreshStats::kOvershootBuckets; i++) {
+        counts[i] = stats->overshoot_histogram_us[i].load(memory_order_relaxed);
+        total_count += counts[i];
+    }
+    if (total_count == 0) {
+        printf("No samples; only the hardware pin pulser records them.\n");
+        return;
+    }
+    uint64_t running_count = 0;
+    for (int us = 0; us < RefreshStats::kOvershootBuckets; us++) {
+        if (counts[us] == 0)
+            continue;
+        running_count += counts[us];
+        printf("%s%3dus: %8u %7.3f%%\n", (us == 0) ? "<=" : " +", us,
+            counts[us], 100.0 * running_count / total_count);
+    }
+}
+
+// Error in microseconds that "fraction" of the waits in "row" did not exceed.
+static int sleep_error_percentile(const uint32_t *row, uint64_t total,
+        double fraction) {
+    uint64_t count = 0;
+    for (int b = 0; b < RefreshStats::kSleepErrorBuckets; b++) {
+        count += row[b];
+        if (count >= fraction * total)
+            return b - RefreshStats::kSleepEarlyUs;
+    }
+    return RefreshStats::kSleepErrorBuckets - 1 - RefreshStats::kSleepEarlyUs;
+}
+
+static void print_sleep_histogram(const RefreshStats *stats) {
+    printf("Actual minus requested time of the timer based pulser in us "
+        "(range %d..%d)\n%9s %9s %6s %6s %6s %6s %6s\n",
+        -RefreshStats::kSleepEarlyUs,
+        RefreshStats::kSleepErrorBuckets - 1 - RefreshStats::kSleepEarlyUs,
+        "request", "count", "min", "p50", "p99", "p99.9", "max");
+    bool any = false;
+    for (int r = 0; r < RefreshStats::kSleepRequestBuckets; r++) {
+        uint32_t row[RefreshStats::kSleepErrorBuckets];
+        uint64_t total = 0;
+        for (int b = 0; b < RefreshStats::kSleepErrorBuckets; b++) {
+            row[b] = stats->sleep_histogram[r][b].load(memory_order_relaxed);
+            total += row[b];
+        }
+        if (total == 0)
+            continue;
+        any = true;
+        printf("%7uus+ %9" PRIu64 " %6d %6d %6d %6d %6d\n",
+            RefreshStats::SleepRequestStart(r), total,
+            sleep_error_percentile(row, total, 0),
+            sleep_error_percentile(row, total, 0.5),
+            sleep_error_percentile(row, total, 0.99),
+            sleep_error_percentile(row, total, 0.999),
+            sleep_error_percentile(row, total, 1.0));
+    }
+    if (!any)
+        printf("No samples; only the timer based pin pulser records them.\n");
+}
+
+int main(int argc, char *argv[]) {
+    double interval = 1;
+    bool overshoot = false;
+    bool sleep = false;
+    while (true) {
+        static struct option long_options[] = {
+            {"interval", required_argument, 0, 'i'},
+            {"overshoot", no_argument, 0, 'o'},
+            {"sleep", no_argument, 0, 's'},
+            {0, 0, 0, 0}
+        };
+        int opt = getopt_long(argc, argv, "i:os", long_options, NULL);
+        if (opt == -1)
+            break;
+        switch (opt) {
+            case 'i':
+                interval = atof(optarg);
+                if (interval <= 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'o':
+                overshoot = true;
+                break;
+            case 's':
+                sleep = true;
+                break;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const char *name = argv[optind];
+    const RefreshStats *stats = RefreshStats::Open(name);
+    if (stats == NULL) {
+        cerr << "No refresh statistics '" << name << "'. Is the matrix "
+            "running with --led-refresh-stats=" << name << "?" << endl;
+        return 1;
+    }
+
+    if (overshoot || sleep) {
+        if (overshoot)
+            print_overshoot_histogram(stats);
+        if (sleep)
+            print_sleep_histogram(stats);
+        RefreshStats::Close(stats);
+        return 0;
+    }
+
+    printf("%9s %7s %7s %7s %7s %7s %7s %7s %7s\n", "Hz", "last", "min",
+        "max", "p50", "p99", "p99.9", "p100", "missed");
+    Snapshot before = take_snapshot(stats);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    while (true) {
+        this_thread::sleep_for(chrono::duration<double>(interval));
+        const Snapshot now = take_snapshot(stats);
+        const chrono::steady_clock::time_point end = chrono::steady_clock::now();
+        const double elapsed = chrono::duration<double>(end - start).count();
+
+        // Percentiles are over the last interval, min and max since start.
+        const uint32_t frames = now.frame_count - before.frame_count;
+        if (frames > elapsed * 1e6) {
+            // More than one frame per microsecond: the counters went back
+            // because the matrix program was restarted.
+            printf("Restarted.\n");
+            before = now;
+            start = end;
+            continue;
+        }
+        uint32_t histogram[RefreshStats::kFrameBuckets];
+        for (int i = 0; i < RefreshStats::kFrameBuckets; i++)
+            histogram[i] = now.frame_histogram[i] - before.frame_histogram[i];
+        printf("%9.1f %7u %7u %7u", frames / elapsed,
+            stats->last_frame_us.load(memory_order_relaxed),
+            stats->min_frame_us.load(memory_order_relaxed),
+            stats->max_frame_us.load(memory_order_relaxed));
+        if (frames > 0) {
+            printf(" %7u %7u %7u %7u", percentile_us(histogram, frames, 0.5),
+                percentile_us(histogram, frames, 0.99),
+                percentile_us(histogram, frames, 0.999),
+                percentile_us(histogram, frames, 1.0));
+        } else {
+            printf(" %7s %7s %7s %7s", "-", "-", "-", "-");
+        }
+        printf(" %7u\n", now.missed_swaps - before.missed_swaps);
+        fflush(stdout);
+
+        before = now;
+        start = end;
+    }
+}
@@ -0,0 +1,150 @@
+#include "led-matrix.h"
+
+#include <getopt.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+using namespace rgb_matrix;
+
+// Measures how many pixels per second FrameCanvas::SetPixel() sets, which is
+// mostly the lookup of where each pixel goes in the framebuffer. Without
+// hardware or a refresh thread, so it works on any Linux machine.
+
+static void print_usage(const char *prog_name) {
+    cerr <<
+    "Usage: " << prog_name << " [options]\n\nOptions:\n\t--seconds, -t : Ho"
+    "w long to measure each order (default=1).\n\nThe --led-* flags set up "
+    "the matrix, e.g. --led-chain=8 --led-parallel=3\n--led-pixel-mapper=Rot"
+    "ate:90.\n";
+    PrintMatrixFlags(stderr);
+}
+
+struct Pixel {
+    int x, y;
+};
+
+// All pixels of the canvas once, row by row, column by column or shuffled.
+static vector<Pixel> pixel_order(int width, int height, const string &order) {
+    vector<Pixel> pixels;
+    pixels.reserve(width * height);
+    if (order == "columns") {
+        for (int x = 0; x < width; x++)
+            for (int y = 0; y < height; y++)
+                pixels.push_back({ x, y });
+        return pixels;
+    }
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            pixels.push_back({ x, y });
+    if (order == "random") {
+        uint32_t state = 12345;
+        for (size_t i = pixels.size() - 1; i > 0; i--) {
+            state = state * 1664525 + 1013904223;
+            swap(pixels[i], pixels[(state >> 8) % (i + 1)]);
+        }
+    }
+    return pixels;
+}
+
+// Sets all "pixels" over and over for "seconds"; returns pixels per second.
+static double measure(FrameCanvas *canvas, const vector<Pixel> &pixels,
+        double seconds) {
+    uint64_t count = 0;
+    uint8_t shade = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    double elapsed;
+    do {
+        for (size_t i = 0; i < pixels.size(); i++) {
+            canvas->SetPixel(pixels[i].x, pixels[i].y, shade, shade ^ 0x55,
+                uint8_t(i));
+        }
+        shade++;
+        count += pixels.size();
+        elapsed = chrono::duration<double>(
+            chrono::steady_clock::now() - start).count();
+    } while (elapsed < seconds);
+    return count / elapsed;
+}
+
+// FNV-1a over the framebuffer content, to compare two versions.
+static uint64_t checksum(const FrameCanvas *canvas) {
+    const char *data;
+    size_t len;
+    canvas->Serialize(&data, &len);
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= uint8_t(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+int main(int argc, char *argv[]) {
+    RGBMatrix::Options matrix_options;
+    RuntimeOptions runtime_options;
+    if (!ParseOptionsFromFlags(&argc, &argv, &matrix_options,
+            &runtime_options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    double seconds = 1;
+    while (true) {
+        static struct option long_options[] = {
+            {"seconds", required_argument, 0, 't'},
+            {0, 0, 0, 0}
+        };
+        int opt = getopt_long(argc, argv, "t:", long_options, NULL);
+        if (opt == -1)
+            break;
+        switch (opt) {
+            case 't':
+                seconds = atof(optarg);
+                if (seconds <= 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    string error;
+    if (!matrix_options.Validate(&error)) {
+        cerr << error << endl;
+        return 1;
+    }
+
+    // No GPIO, so no refresh thread competing for the CPU.
+    RGBMatrix *matrix = new RGBMatrix(NULL, matrix_options);
+    FrameCanvas *canvas = matrix->CreateFrameCanvas();
+    cout << canvas->width() << "x" << canvas->height() << " pixels" << endl;
+
+    const char *orders[] = { "rows", "columns", "random" };
+    for (const char *order : orders) {
+        const vector<Pixel> pixels = pixel_order(canvas->width(),
+            canvas->height(), order);
+        const double rate = measure(canvas, pixels, seconds);
+        cout << "SetPixel() " << order << ": " << rate / 1e6 << " Mpixels/s ("
+            << 1e9 / rate << " ns per pixel)" << endl;
+    }
+
+    // Same pattern every time, to compare the output of two versions.
+    canvas->Clear();
+    const vector<Pixel> pixels = pixel_order(canvas->width(), canvas->height(),
+        "rows");
+    for (size_t i = 0; i < pixels.size(); i++) {
+        canvas->SetPixel(pixels[i].x, pixels[i].y, uint8_t(i * 7),
+            uint8_t(i >> 3), uint8_t(pixels[i].x ^ pixels[i].y));
+    }
+    cout << "Framebuffer checksum: " << hex << checksum(canvas) << dec << endl;
+
+    delete matrix;
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include "gpio.h"
+#include "thread.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace rgb_matrix;
+
+// Measures how much longer than requested nanosleep() takes on this machine
+// and derives the SleepTiming constants from it: the median overshoot is the
+// overhead, a high percentile the jitter allowance. Works on any Linux
+// machine, as it only uses clock_nanosleep() and CLOCK_MONOTONIC.
+
+// Requested sleeps, in microseconds. The pin pulsers sleep for the length of
+// an output-enable pulse minus the jitter allowance, so mostly within these.
+static const long kRequestsUs[] = { 5, 10, 20, 50, 100, 200 };
+static const int kRequestCount = sizeof(kRequestsUs) / sizeof(kRequestsUs[0]);
+
+static void print_usage(const char *prog_name) {
+    cerr <<
+    "Usage: " << prog_name << " [options]\n\nOptions:\n"
+    "\t--samples, -s : Sleeps per requested time (default=3000).\n"
+    "\t--percentile, -p : Overshoot percentile to use as jitter allowance\n"
+    "\t                   (default=99.9; 99.999 if there is CPU to spare).\n"
+    "\t--output, -o : Config file to write (default=" <<
+    SleepTiming::ConfigFile() << ").\n"
+    "\t--dry-run, -n : Only show the results.\n";
+}
+
+static long now_nanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Does the sleeping in a thread set up like the refresh thread, as that is
+// where the timing matters.
+class Measurement : public Thread {
+public:
+    Measurement(int samples) : samples_(samples) {
+        for (int r = 0; r < kRequestCount; r++)
+            overshoot_ns_[r].reserve(samples);
+    }
+
+    virtual void Run() {
+        for (int i = 0; i < samples_; i++) {
+            for (int r = 0; r < kRequestCount; r++) {
+                const struct timespec request = { 0, kRequestsUs[r] * 1000 };
+                const long start = now_nanos();
+                clock_nanosleep(CLOCK_MONOTONIC, 0, &request, NULL);
+                overshoot_ns_[r].push_back(now_nanos() - start
+                    - kRequestsUs[r] * 1000);
+            }
+        }
+        for (int r = 0; r < kRequestCount; r++)
+            sort(overshoot_ns_[r].begin(), overshoot_ns_[r].end());
+    }
+
+    const vector<long> &overshoot_ns(int r) const { return overshoot_ns_[r]; }
+
+private:
+    const int samples_;
+    vector<long> overshoot_ns_[kRequestCount];
+};
+
+static double percentile_us(const vector<long> &sorted_ns, double percent) {
+    const size_t i = min(sorted_ns.size() - 1,
+        size_t(percent / 100 * sorted_ns.size()));
+    return sorted_ns[i] / 1000.0;
+}
+
+int main(int argc, char *argv[]) {
+    int samples = 3000;
+    double percentile = 99.9;
+    string output = SleepTiming::ConfigFile();
+    bool dry_run = false;
+    while (true) {
+        static struct option long_options[] = {
+            {"samples", required_argument, 0, 's'},
+            {"percentile", required_argument, 0, 'p'},
+            {"output", required_argument, 0, 'o'},
+            {"dry-run", no_argument, 0, 'n'},
+            {0, 0, 0, 0}
+        };
+        int opt = getopt_long(argc, argv, "s:p:o:n", long_options, NULL);
+        if (opt == -1)
+            break;
+        switch (opt) {
+            case 's':
+                samples = atoi(optarg);
+                break;
+            case 'p':
+                percentile = atof(optarg);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'n':
+                dry_run = true;
+                break;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (samples <= 0 || percentile <= 50 || percentile >= 100
+        || optind != argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Same priority and core as the refresh thread. Without root, this is
+    // an ordinary thread, and the numbers show that.
+    Measurement measurement(samples);
+    measurement.Start(99, (1<<3));
+    measurement.WaitStopped();
+
+    printf("Overshoot of clock_nanosleep() in us\n%9s %7s %7s %7s %7s %7s\n",
+        "request", "p50", "p99", "p99.9", "p99.99", "max");
+    vector<long> all_ns;
+    for (int r = 0; r < kRequestCount; r++) {
+        const vector<long> &ns = measurement.overshoot_ns(r);
+        printf("%7ldus %7.1f %7.1f %7.1f %7.1f %7.1f\n", kRequestsUs[r],
+            percentile_us(ns, 50), percentile_us(ns, 99),
+            percentile_us(ns, 99.9), percentile_us(ns, 99.99),
+            ns.back() / 1000.0);
+        all_ns.insert(all_ns.end(), ns.begin(), ns.end());
+    }
+    sort(all_ns.begin(), all_ns.end());
+
+    SleepTiming timing;
+    timing.nanosleep_overhead_us = max(0.0, ceil(percentile_us(all_ns, 50)));
+    timing.jitter_allowance_us = max<double>(timing.nanosleep_overhead_us,
+        ceil(percentile_us(all_ns, percentile)));
+    printf("\nnanosleep_overhead_us=%d (median)\n"
+        "jitter_allowance_us=%d (%g%%-ile)\n", timing.nanosleep_overhead_us,
+        timing.jitter_allowance_us, percentile);
+    if (dry_run)
+        return 0;
+
+    char comment[256];
+    snprintf(comment, sizeof(comment), "Measured by sleep-calibrate from %zu "
+        "sleeps: median and %g%%-ile of the\novershoot of nanosleep().",
+        all_ns.size(), percentile);
+    if (!timing.Save(output.c_str(), comment)) {
+        cerr << "Can't write " << output << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    cout << "Wrote " << output << endl;
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include "thread.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <stdint.h>
+
+using namespace std;
+using namespace rgb_matrix;
+
+// Measures what the refresh thread spends on synchronization per frame:
+// the running() check and the SwapOnVSync() exchange. The mutex variant is
+// the refresh loop before it used atomics, kept for comparison; the atomic
+// variant is what the loop in lib/led-matrix.cc does now. Optionally, a
+// second thread keeps handing over frames, as a producer would.
+
+// Stand-in for FrameCanvas pointers.
+static int frames[3];
+
+class MutexSync {
+public:
+    MutexSync() : running_(true), current_(&frames[0]), next_(NULL),
+        requested_frame_multiple_(1) {
+        pthread_cond_init(&frame_done_, NULL);
+    }
+
+    bool running() {
+        MutexLock l(&running_mutex_);
+        return running_;
+    }
+
+    void EndOfFrame(unsigned *frame_count) {
+        MutexLock l(&frame_sync_);
+        if (*frame_count == requested_frame_multiple_
+            || *frame_count % requested_frame_multiple_ == 0) {
+            *frame_count = 0;
+            if (next_ != NULL) {
+                current_ = next_;
+                next_ = NULL;
+            }
+            pthread_cond_signal(&frame_done_);
+        }
+    }
+
+    // Like SwapOnVSync(), but without waiting.
+    void Handover(int *frame) {
+        MutexLock l(&frame_sync_);
+        next_ = frame;
+    }
+
+private:
+    Mutex running_mutex_;
+    bool running_;
+    Mutex frame_sync_;
+    pthread_cond_t frame_done_;
+    int *current_;
+    int *next_;
+    unsigned requested_frame_multiple_;
+};
+
+class AtomicSync {
+public:
+    AtomicSync() : running_(true), current_(&frames[0]), vsync_waiters_(0),
+        published_(0) {}
+
+    bool running() {
+        return running_.load(memory_order_acquire);
+    }
+
+    void EndOfFrame(unsigned *frame_count) {
+        if (published_.load(memory_order_acquire) & 1) {
+            const uintptr_t published = published_.exchange(
+                reinterpret_cast<uintptr_t>(current_), memory_order_acq_rel);
+            current_ = reinterpret_cast<int *>(published & ~uintptr_t(1));
+        }
+        if (vsync_waiters_.load(memory_order_acquire) > 0) {
+            // Not reached: nobody waits in SwapOnVSync() here.
+            *frame_count = 0;
+        }
+    }
+
+    // Like PublishFrame().
+    void Handover(int *frame) {
+        published_.exchange(reinterpret_cast<uintptr_t>(frame) | 1,
+            memory_order_acq_rel);
+    }
+
+private:
+    atomic<bool> running_;
+    int *current_;
+    atomic<int> vsync_waiters_;
+    atomic<uintptr_t> published_;
+};
+
+template <class Sync>
+class Producer : public Thread {
+public:
+    Producer(Sync *sync) : sync_(sync), running_(true) {}
+    void Stop() { running_.store(false); }
+    virtual void Run() {
+        for (int i = 0; running_.load(); i++)
+            sync_->Handover(&frames[1 + i % 2]);
+    }
+
+private:
+    Sync *const sync_;
+    atomic<bool> running_;
+};
+
+// Nanoseconds per frame, best of a few runs.
+template <class Sync>
+static double time_ns_per_frame(bool with_producer) {
+    const int FRAMES = 10000000;
+    const int RUNS = 5;
+    double best = 0;
+    for (int run = 0; run < RUNS; run++) {
+        Sync sync;
+        Producer<Sync> producer(&sync);
+        if (with_producer)
+            producer.Start();
+        unsigned frame_count = 0;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (int i = 0; i < FRAMES && sync.running(); i++) {
+            sync.EndOfFrame(&frame_count);
+            ++frame_count;
+        }
+        chrono::duration<double, nano> elapsed =
+            chrono::steady_clock::now() - start;
+        producer.Stop();
+        if (run == 0 || elapsed.count() / FRAMES < best)
+            best = elapsed.count() / FRAMES;
+    }
+    return best;
+}
+
+int main() {
+    for (int with_producer = 0; with_producer < 2; with_producer++) {
+        const double mutex_ns = time_ns_per_frame<MutexSync>(with_producer);
+        const double atomic_ns = time_ns_per_frame<AtomicSync>(with_producer);
+        cout << (with_producer ? "With producer: " : "Idle: ")
+            << "mutexes " << mutex_ns << " ns/frame, atomics " << atomic_ns
+            << " ns/frame (" << mutex_ns / atomic_ns << "x faster)" << endl;
+    }
+    return 0;
+}